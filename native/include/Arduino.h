@@ -0,0 +1,86 @@
+#ifndef ARDUINO_H
+#define ARDUINO_H
+
+// Host stand-in for the subset of the Arduino core used by the protocol. Time
+// and randomness come from the simulated node currently running on this
+// thread, see sim.h.
+
+#include <algorithm>
+#include <cstdarg>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+#include <esp_err.h>
+
+using std::max;
+using std::min;
+
+#define HIGH 0x1
+#define LOW 0x0
+
+#define INPUT 0x01
+#define OUTPUT 0x03
+
+class String {
+public:
+  String() {}
+  String(const char *str) : _str(str == nullptr ? "" : str) {}
+  String(const std::string &str) : _str(str) {}
+  String(char c) : _str(1, c) {}
+  String(int value) : _str(std::to_string(value)) {}
+  String(unsigned int value) : _str(std::to_string(value)) {}
+  String(long value) : _str(std::to_string(value)) {}
+  String(unsigned long value) : _str(std::to_string(value)) {}
+
+  const char *c_str() const { return _str.c_str(); }
+  unsigned int length() const { return _str.length(); }
+  char operator[](unsigned int index) const { return _str[index]; }
+  String substring(unsigned int from) const { return _str.substr(from); }
+  String substring(unsigned int from, unsigned int to) const {
+    return _str.substr(from, to - from);
+  }
+
+  String &operator+=(const String &other) {
+    _str += other._str;
+    return *this;
+  }
+  friend String operator+(const String &a, const String &b) {
+    return a._str + b._str;
+  }
+  bool operator==(const String &other) const { return _str == other._str; }
+  bool operator!=(const String &other) const { return _str != other._str; }
+
+private:
+  std::string _str;
+};
+
+class HardwareSerial {
+public:
+  void begin(unsigned long baud) {}
+  void print(const String &str) { fputs(str.c_str(), stdout); }
+  void println(const String &str) { printf("%s\n", str.c_str()); }
+  void println() { printf("\n"); }
+  int printf(const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    int written = vprintf(format, args);
+    va_end(args);
+    return written;
+  }
+};
+
+extern HardwareSerial Serial;
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+
+uint32_t esp_random();
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t value);
+int digitalRead(uint8_t pin);
+
+#endif // ARDUINO_H
@@ -0,0 +1,35 @@
+#ifndef PREFERENCES_H
+#define PREFERENCES_H
+
+// Host stand-in for the ESP32 NVS-backed Preferences. Every simulated node has
+// its own storage, which survives the node being power cycled.
+
+#include <Arduino.h>
+
+class Preferences {
+public:
+  bool begin(const char *name, bool read_only = false);
+  void end();
+
+  bool clear();
+  bool remove(const char *key);
+  bool isKey(const char *key);
+
+  size_t putInt(const char *key, int32_t value);
+  size_t putUInt(const char *key, uint32_t value);
+  size_t putString(const char *key, const String &value);
+  size_t putBytes(const char *key, const void *value, size_t len);
+
+  int32_t getInt(const char *key, int32_t default_value = 0);
+  uint32_t getUInt(const char *key, uint32_t default_value = 0);
+  String getString(const char *key, const String &default_value = String());
+  size_t getBytesLength(const char *key);
+  size_t getBytes(const char *key, void *buf, size_t max_len);
+
+private:
+  String _namespace;
+  bool _started = false;
+  bool _read_only = false;
+};
+
+#endif // PREFERENCES_H
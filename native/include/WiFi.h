@@ -0,0 +1,22 @@
+#ifndef WIFI_H
+#define WIFI_H
+
+#include <Arduino.h>
+
+typedef enum {
+  WIFI_OFF,
+  WIFI_STA,
+  WIFI_AP,
+  WIFI_AP_STA,
+} wifi_mode_t;
+
+class WiFiClass {
+public:
+  bool mode(wifi_mode_t mode);
+  String macAddress();
+  uint8_t *macAddress(uint8_t *mac);
+};
+
+extern WiFiClass WiFi;
+
+#endif // WIFI_H
@@ -0,0 +1,38 @@
+#ifndef QUEUE_TRANSPORT_H
+#define QUEUE_TRANSPORT_H
+
+#include <deque>
+#include <mutex>
+#include <vector>
+
+#include <transport/transport.h>
+
+// Host in-memory transport between QueueTransport instances of the same
+// process. Frames wait in the receiver's queue until its next poll().
+class QueueTransport : public Transport {
+public:
+  QueueTransport();
+  QueueTransport(const uint8_t *mac);
+  ~QueueTransport();
+  bool begin(TransportRecv recv, TransportSent sent) override;
+  bool addPeer(const uint8_t *mac) override { return true; }
+  bool removePeer(const uint8_t *mac) override { return true; }
+  void macAddress(uint8_t *mac) override;
+  esp_err_t send(const uint8_t *mac, const uint8_t *data, size_t len) override;
+  void poll() override;
+
+private:
+  struct Frame {
+    uint8_t mac[6];
+    std::vector<uint8_t> data;
+  };
+  void push(const uint8_t *mac, const uint8_t *data, size_t len);
+
+  uint8_t _mac[6];
+  TransportRecv _recv = nullptr;
+  TransportSent _sent = nullptr;
+  std::mutex _mutex;
+  std::deque<Frame> _queue;
+};
+
+#endif // QUEUE_TRANSPORT_H
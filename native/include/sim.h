@@ -0,0 +1,89 @@
+#ifndef SIM_H
+#define SIM_H
+
+// In-process simulation of a bomb. Every node runs its setup/loop on its own
+// thread so the NODE_LOCAL protocol state stays separate, and all nodes advance
+// in lockstep over a shared simulated ESP-NOW medium. Frames sent during one
+// tick are delivered no earlier than the next one, which keeps runs
+// deterministic for a given seed.
+//
+// Time is discrete-event: a node that calls idle() is not due again until
+// then or until a frame or send report reaches it, and when no node is due
+// the clock jumps straight to the next one that is.
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+
+namespace Sim {
+using Program = std::function<void()>;
+
+struct MediumConfig {
+  unsigned long tick_us = 1000;
+  unsigned long latency_us = 1000;
+  // Extra delay drawn uniformly from [0, jitter_us] for every reception.
+  unsigned long jitter_us = 0;
+  // Gilbert-Elliott loss: each receiver's channel is good or bad, moving to
+  // bad with probability burst_start and back with burst_end before every
+  // frame. Frames are lost with probability `loss` on a good channel and
+  // `burst_loss` on a bad one.
+  double loss = 0;
+  double burst_loss = 0;
+  double burst_start = 0;
+  double burst_end = 1;
+  // Frames share one channel: they go out one after the other at 1 Mbps after
+  // a random backoff, and frames that draw the same backoff slot collide and
+  // reach nobody. Without it the medium is ideal and airtime only counted.
+  bool collisions = false;
+  uint32_t seed = 1;
+  // Frames a node can have waiting for their send callback before
+  // esp_now_send fails with ESP_ERR_ESPNOW_NO_MEM, 0 for no limit.
+  unsigned tx_buffers = 0;
+};
+
+struct MediumStats {
+  unsigned long frames = 0;
+  unsigned long bytes = 0;
+  unsigned long delivered = 0;
+  unsigned long dropped = 0;
+  unsigned long collided = 0;
+  // Time the channel was busy, acks included.
+  uint64_t airtime_us = 0;
+};
+
+void configure(MediumConfig config);
+int addNode(const uint8_t *mac, Program setup, Program loop);
+// Runs every node once and moves the clock to when the next one is due.
+void step();
+// Steps until `done` returns true or `timeout_ms` of simulated time elapse.
+// Returns whether `done` was satisfied.
+bool runUntil(std::function<bool()> done, unsigned long timeout_ms);
+void clear();
+
+// Called from a node's loop: it has nothing to do for `ms` unless a frame
+// arrives. Nodes that never call it run every tick.
+void idle(unsigned long ms);
+// Called from a node's loop: the node loses power for good, it neither runs
+// nor sends or receives frames any more.
+void powerOff();
+// Called from a node's loop: the node restarts. Its NODE_LOCAL state is gone
+// and its radio off until it runs its setup again on the next tick; its flash
+// and the clock are kept.
+void restart();
+// Frames `drop` returns true for reach nobody, to script losses the random
+// ones would rarely produce. Called between steps, reset by clear().
+using FrameFilter =
+    std::function<bool(const uint8_t *src, const uint8_t *data, size_t len)>;
+void setFrameFilter(FrameFilter drop);
+
+unsigned long now();
+MediumStats stats();
+// Heap allocations the nodes made after their setup, leaving out those of the
+// simulated radio and flash.
+unsigned long allocations();
+// Time a frame of `bytes` keeps the channel busy, with the ack of a unicast
+// frame.
+uint64_t airtimeUs(size_t bytes, bool unicast);
+} // namespace Sim
+
+#endif // SIM_H
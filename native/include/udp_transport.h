@@ -0,0 +1,33 @@
+#ifndef UDP_TRANSPORT_H
+#define UDP_TRANSPORT_H
+
+#include <transport/transport.h>
+
+// Host stand-in for ESP-NOW over UDP multicast, so native builds on different
+// processes or machines of the same network can play together. Every datagram
+// carries the source and destination MACs ahead of the protocol frame, and
+// receivers drop the ones that are not for them.
+class UdpTransport : public Transport {
+public:
+  UdpTransport(const char *group = "239.255.42.42", uint16_t port = 4242);
+  UdpTransport(const uint8_t *mac, const char *group = "239.255.42.42",
+               uint16_t port = 4242);
+  ~UdpTransport();
+  bool begin(TransportRecv recv, TransportSent sent) override;
+  bool addPeer(const uint8_t *mac) override { return true; }
+  bool removePeer(const uint8_t *mac) override { return true; }
+  void macAddress(uint8_t *mac) override;
+  esp_err_t send(const uint8_t *mac, const uint8_t *data, size_t len) override;
+  void poll() override;
+
+private:
+  uint8_t _mac[6];
+  bool _has_mac;
+  const char *_group;
+  uint16_t _port;
+  int _socket = -1;
+  TransportRecv _recv = nullptr;
+  TransportSent _sent = nullptr;
+};
+
+#endif // UDP_TRANSPORT_H
@@ -0,0 +1,20 @@
+#include <Arduino.h>
+
+#include "node.h"
+
+HardwareSerial Serial;
+
+unsigned long millis() { return Sim::nowMicros() / 1000; }
+
+unsigned long micros() { return Sim::nowMicros(); }
+
+// Simulated time only moves between ticks, so blocking would never return.
+void delay(unsigned long ms) {}
+
+uint32_t esp_random() { return Sim::currentNode()->rng(); }
+
+void pinMode(uint8_t pin, uint8_t mode) {}
+
+void digitalWrite(uint8_t pin, uint8_t value) {}
+
+int digitalRead(uint8_t pin) { return LOW; }
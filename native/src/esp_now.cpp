@@ -0,0 +1,100 @@
+#include <cstring>
+
+#include <esp_now.h>
+
+#include "node.h"
+
+esp_err_t esp_now_init(void) {
+  Sim::currentNode()->esp_now_started = true;
+  return ESP_OK;
+}
+
+esp_err_t esp_now_deinit(void) {
+  Sim::PlatformHeap heap;
+  Sim::Node *node = Sim::currentNode();
+  node->esp_now_started = false;
+  node->recv_cb = nullptr;
+  node->send_cb = nullptr;
+  node->peers.clear();
+  return ESP_OK;
+}
+
+esp_err_t esp_now_register_recv_cb(esp_now_recv_cb_t cb) {
+  Sim::Node *node = Sim::currentNode();
+  if (!node->esp_now_started)
+    return ESP_ERR_ESPNOW_NOT_INIT;
+  node->recv_cb = cb;
+  return ESP_OK;
+}
+
+esp_err_t esp_now_unregister_recv_cb(void) {
+  Sim::currentNode()->recv_cb = nullptr;
+  return ESP_OK;
+}
+
+esp_err_t esp_now_register_send_cb(esp_now_send_cb_t cb) {
+  Sim::Node *node = Sim::currentNode();
+  if (!node->esp_now_started)
+    return ESP_ERR_ESPNOW_NOT_INIT;
+  node->send_cb = cb;
+  return ESP_OK;
+}
+
+esp_err_t esp_now_unregister_send_cb(void) {
+  Sim::currentNode()->send_cb = nullptr;
+  return ESP_OK;
+}
+
+esp_err_t esp_now_send(const uint8_t *peer_addr, const uint8_t *data,
+                       size_t len) {
+  Sim::Node *node = Sim::currentNode();
+  if (!node->esp_now_started)
+    return ESP_ERR_ESPNOW_NOT_INIT;
+  if (peer_addr == nullptr || data == nullptr || len == 0 ||
+      len > ESP_NOW_MAX_DATA_LEN)
+    return ESP_ERR_ESPNOW_ARG;
+  if (node->peers.count(Sim::macToKey(peer_addr)) == 0)
+    return ESP_ERR_ESPNOW_NOT_FOUND;
+  unsigned tx_buffers = Sim::config().tx_buffers;
+  if (tx_buffers != 0 && node->tx_in_flight >= tx_buffers)
+    return ESP_ERR_ESPNOW_NO_MEM;
+  node->tx_in_flight++;
+  // The driver's tx buffers are not the node's heap.
+  Sim::PlatformHeap heap;
+  Sim::Frame frame;
+  memcpy(frame.src, node->mac, ESP_NOW_ETH_ALEN);
+  memcpy(frame.dest, peer_addr, ESP_NOW_ETH_ALEN);
+  frame.data.assign(data, data + len);
+  node->outbox.push_back(frame);
+  return ESP_OK;
+}
+
+esp_err_t esp_now_add_peer(const esp_now_peer_info_t *peer) {
+  Sim::PlatformHeap heap;
+  Sim::Node *node = Sim::currentNode();
+  if (!node->esp_now_started)
+    return ESP_ERR_ESPNOW_NOT_INIT;
+  if (peer == nullptr)
+    return ESP_ERR_ESPNOW_ARG;
+  uint64_t key = Sim::macToKey(peer->peer_addr);
+  if (node->peers.count(key) != 0)
+    return ESP_ERR_ESPNOW_EXIST;
+  if (node->peers.size() >= ESP_NOW_MAX_TOTAL_PEER_NUM)
+    return ESP_ERR_ESPNOW_FULL;
+  node->peers.insert(key);
+  return ESP_OK;
+}
+
+esp_err_t esp_now_del_peer(const uint8_t *peer_addr) {
+  Sim::PlatformHeap heap;
+  Sim::Node *node = Sim::currentNode();
+  if (!node->esp_now_started)
+    return ESP_ERR_ESPNOW_NOT_INIT;
+  if (node->peers.erase(Sim::macToKey(peer_addr)) == 0)
+    return ESP_ERR_ESPNOW_NOT_FOUND;
+  return ESP_OK;
+}
+
+bool esp_now_is_peer_exist(const uint8_t *peer_addr) {
+  return Sim::currentNode()->peers.count(Sim::macToKey(peer_addr)) != 0;
+}
@@ -0,0 +1,30 @@
+#include <cstdlib>
+#include <new>
+
+#include "node.h"
+
+// Every heap allocation of the program goes through here so the harness can
+// check that a node's code no longer allocates once it is set up.
+
+namespace Sim {
+thread_local unsigned long *_allocations = nullptr;
+
+void countAllocations(unsigned long *counter) { _allocations = counter; }
+
+PlatformHeap::PlatformHeap() : _saved(_allocations) { _allocations = nullptr; }
+
+PlatformHeap::~PlatformHeap() { _allocations = _saved; }
+} // namespace Sim
+
+void *operator new(size_t size) {
+  if (Sim::_allocations != nullptr)
+    ++*Sim::_allocations;
+  void *memory = malloc(size == 0 ? 1 : size);
+  if (memory == nullptr)
+    throw std::bad_alloc();
+  return memory;
+}
+
+void operator delete(void *memory) noexcept { free(memory); }
+
+void operator delete(void *memory, size_t) noexcept { free(memory); }
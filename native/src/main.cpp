@@ -0,0 +1,511 @@
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <cstdlib>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include <main_module.h>
+#include <needy_module.h>
+#include <puzzle_module.h>
+#include <queue_transport.h>
+#include <sim.h>
+#include <stats.h>
+#include <udp_transport.h>
+
+// Scenario suite: plays scripted games of one main module against puzzle and
+// needy modules over the simulated medium and reports how long each phase of
+// the protocol takes. A game boots every node at 0 and:
+//   - discover: until the main module knows every module, and how many it
+//     never found before the reset,
+//   - start: from the end of the countdown until every module started, and
+//     the skew between the first and the last one,
+//   - strike: from a module's strike until the main module counted it,
+//   - reset: from the reset after the bomb is solved until every module
+//     acknowledged it,
+//   - detect: from a module losing power mid-game until the main module
+//     suspected it, and how many modules still running it suspected,
+//   - heartbeat: airtime of the heartbeats and their answers, taking every
+//     one as a frame of its own,
+//   - replay: in scenarios that play on, from the reset until the next game,
+//     without the module that went away, was solved,
+//   - allocs: heap allocations of the nodes after their setup, which must stay
+//     at 0 over ESP-NOW.
+// Runs are reproducible: the same scenario and seed give the same numbers.
+// Usage: bomb [scenario|all] [games] [esp-now|queue|udp]
+
+const unsigned long NEVER = ULONG_MAX;
+const unsigned long GAME_TIMEOUT = 60000;
+const int START_AFTER = 2;
+const unsigned long STRIKE_DELAY = 50;
+const unsigned long SOLVE_DELAY = 100;
+const unsigned long BROWNOUT_AFTER = 2000;
+const unsigned long RESTART_AFTER = 1000;
+
+// `brownouts` modules picked at random lose power BROWNOUT_AFTER ms after they
+// started, puzzle modules among them once they solved their puzzle. With
+// `replay`, a module picked at random is pulled at the reset and the others
+// play a second game. With `restart`, the module that strikes restarts
+// RESTART_AFTER ms after it started and loses every ANNOUNCE it sends until it
+// connected again, so the main module only hears from it once it is connected.
+// It has to solve again, with solve attempt keys counted from scratch, before
+// the game ends.
+struct Scenario {
+  const char *name;
+  int puzzle_modules;
+  int needy_modules;
+  Sim::MediumConfig medium;
+  unsigned long solve_delay = SOLVE_DELAY;
+  int brownouts = 0;
+  bool replay = false;
+  bool restart = false;
+};
+
+Sim::MediumConfig medium(unsigned long latency_us, unsigned long jitter_us,
+                         double loss, bool collisions) {
+  Sim::MediumConfig config;
+  config.latency_us = latency_us;
+  config.jitter_us = jitter_us;
+  config.loss = loss;
+  config.collisions = collisions;
+  return config;
+}
+
+Sim::MediumConfig bursty(Sim::MediumConfig config) {
+  config.loss = 0.01;
+  config.burst_loss = 0.5;
+  config.burst_start = 0.05;
+  config.burst_end = 0.25;
+  return config;
+}
+
+Sim::MediumConfig congested(Sim::MediumConfig config) {
+  config.tx_buffers = 4;
+  return config;
+}
+
+const Scenario SCENARIOS[] = {
+    {"ideal", 15, 0, medium(1000, 0, 0, false)},
+    {"jitter", 15, 0, medium(2000, 4000, 0, false)},
+    {"lossy", 15, 0, medium(1000, 0, 0.1, false)},
+    {"bursty", 15, 0, bursty(medium(1000, 0, 0, false))},
+    {"crowded", 50, 10, medium(1000, 0, 0, true)},
+    {"congested", 30, 5, congested(bursty(medium(1000, 0, 0, true)))},
+    {"brownout", 15, 3, medium(1000, 0, 0.05, true), 10000, 1},
+    {"vanish", 15, 0, medium(1000, 0, 0.05, true), SOLVE_DELAY, 0, true},
+    {"restart", 15, 0, medium(1000, 0, 0.05, true), 10000, 0, false, true},
+};
+
+// Written by the node threads, read by the harness between steps.
+struct Game {
+  int modules;
+  int brownouts;
+  int vanishing = -1;
+  int restarting = -1;
+  unsigned long restarted_at = NEVER;
+  bool reconnected = false;
+  unsigned long solve_delay;
+  bool idle;
+  int discovered = 0;
+  unsigned long discovered_at = NEVER;
+  unsigned long struck_at = NEVER;
+  unsigned long strike_counted_at = NEVER;
+  unsigned long solved_at = NEVER;
+  unsigned long reset_at = NEVER;
+  unsigned long replay_at = NEVER;
+  unsigned long replay_solved_at = NEVER;
+  std::vector<unsigned long> started_at;
+  std::vector<unsigned long> reset_seen_at;
+  std::vector<bool> browns_out;
+  std::vector<unsigned long> powered_off_at;
+  std::vector<unsigned long> suspected_at;
+  unsigned long false_suspicions = 0;
+  unsigned long heartbeats = 0;
+  std::vector<unsigned long> heartbeat_acks;
+
+  bool poweredOff(int index) const { return powered_off_at[index] != NEVER; }
+  bool restarted(int index) const {
+    return index == restarting && restarted_at != NEVER;
+  }
+
+  // When the last module still running saw the reset. Modules that lost
+  // power never do.
+  unsigned long resetSeen() const {
+    unsigned long last = 0;
+    for (int i = 0; i < modules; i++)
+      if (!poweredOff(i))
+        last = reset_seen_at[i] == NEVER || last == NEVER
+                   ? NEVER
+                   : max(last, reset_seen_at[i]);
+    return last;
+  }
+};
+
+struct GameResult {
+  bool finished;
+  unsigned long discover, undiscovered, start, skew, strike, reset;
+  unsigned long detect, false_suspicions, heartbeat_airtime_us;
+  unsigned long replay, allocations;
+  Sim::MediumStats stats;
+};
+
+int indexFor(const uint8_t *mac) { return (mac[4] << 8 | mac[5]) - 1; }
+
+void macFor(int index, uint8_t *mac) {
+  uint8_t base[] = {0x24, 0x6f, 0x28, 0x00, 0x00, 0x00};
+  memcpy(mac, base, sizeof(base));
+  mac[4] = index >> 8;
+  mac[5] = index & 0xff;
+}
+
+Transport *makeTransport(const String &kind, const uint8_t *mac) {
+  if (kind == "queue")
+    return new QueueTransport(mac);
+  if (kind == "udp")
+    return new UdpTransport(mac);
+  return nullptr;
+}
+
+// Whether the frame in `data` holds a message of `type`.
+bool carries(const uint8_t *data, size_t len, MessageType type) {
+  size_t i = FRAME_HEADER_SIZE;
+  if (data[1] & FRAME_ADDRESSED)
+    i += MAC_ADDRESS_SIZE;
+  for (; i + 1 < len; i += data[i] + 1)
+    if (data[i + 1] == type)
+      return true;
+  return false;
+}
+
+unsigned long latest(const std::vector<unsigned long> &times) {
+  unsigned long last = 0;
+  for (unsigned long time : times)
+    last = time == NEVER || last == NEVER ? NEVER : max(last, time);
+  return last;
+}
+
+unsigned long since(unsigned long end, unsigned long begin) {
+  return end == NEVER || begin == NEVER ? NEVER : end - begin;
+}
+
+void addMainModule(Game &game, Transport *transport) {
+  uint8_t mac[ESP_NOW_ETH_ALEN];
+  macFor(0, mac);
+  Sim::addNode(
+      mac,
+      [&game, transport]() {
+        if (transport != nullptr)
+          setTransport(transport);
+        MainModule::onSolved = [&game]() {
+          if (game.solved_at == NEVER)
+            game.solved_at = Sim::now();
+          else
+            game.replay_solved_at = Sim::now();
+        };
+        MainModule::onStrike = [&game](int strikes) {
+          if (game.strike_counted_at == NEVER)
+            game.strike_counted_at = Sim::now();
+        };
+        MainModule::onSuspected = [&game](const uint8_t *mac) {
+          int index = indexFor(mac);
+          if (!game.poweredOff(index) && !game.restarted(index))
+            game.false_suspicions++;
+          else if (game.suspected_at[index] == NEVER)
+            game.suspected_at[index] = Sim::now();
+        };
+        MainModule::setup();
+        MainModule::setMaxStrikes(3);
+        MainModule::setDuration(5 * 60 * 1000);
+        MainModule::startAfter(START_AFTER);
+      },
+      [&game]() {
+        MainModule::update();
+        unsigned long now = Sim::now();
+        game.heartbeats = Stats::message(HEARTBEAT).tx;
+        BombInfo info = MainModule::bombInfo();
+        if (game.reset_at == NEVER)
+          game.discovered =
+              info.total_puzzle_modules + info.total_needy_modules;
+        if (game.discovered_at == NEVER && game.discovered == game.modules)
+          game.discovered_at = now;
+        if (game.solved_at != NEVER && game.reset_at == NEVER) {
+          MainModule::reset();
+          game.reset_at = now;
+        }
+        if (game.vanishing != -1 && game.replay_at == NEVER &&
+            game.resetSeen() != NEVER) {
+          MainModule::startAfter(START_AFTER);
+          game.replay_at = now;
+        }
+        if (game.idle)
+          Sim::idle(idleTime());
+      });
+}
+
+void addModule(Game &game, int index, bool needy, Transport *transport) {
+  uint8_t mac[ESP_NOW_ETH_ALEN];
+  macFor(index + 1, mac);
+  Sim::addNode(
+      mac,
+      [needy, transport]() {
+        if (transport != nullptr)
+          setTransport(transport);
+        Module::onManualCode = [](int code) {};
+        if (needy)
+          NeedyModule::setup();
+        else
+          PuzzleModule::setup();
+      },
+      [&game, index, needy]() {
+        static thread_local bool solved = false;
+        if (index == game.vanishing && game.reset_at != NEVER) {
+          game.powered_off_at[index] = Sim::now();
+          Sim::powerOff();
+          return;
+        }
+        if (needy)
+          NeedyModule::update();
+        else
+          PuzzleModule::update();
+        unsigned long now = Sim::now();
+        game.heartbeat_acks[index] = Stats::message(HEARTBEAT_ACK).tx;
+        unsigned long idle = idleTime();
+        Module::Status status = Module::status();
+        if (game.restarted(index) && status != Module::Status::Connecting)
+          game.reconnected = true;
+        if (game.reset_at != NEVER) {
+          if (status == Module::Status::Connected &&
+              game.reset_seen_at[index] == NEVER)
+            game.reset_seen_at[index] = now;
+          if (status == Module::Status::Started && !needy)
+            PuzzleModule::solve();
+        } else if (status == Module::Status::Started ||
+                   status == Module::Status::Solved) {
+          unsigned long &started_at = game.started_at[index];
+          if (started_at == NEVER)
+            started_at = now;
+          if (game.browns_out[index]) {
+            if (now - started_at >= BROWNOUT_AFTER) {
+              game.powered_off_at[index] = now;
+              Sim::powerOff();
+              return;
+            }
+            idle = min(idle, BROWNOUT_AFTER - (now - started_at));
+          }
+          if (index == game.restarting && !game.restarted(index)) {
+            if (now - started_at >= RESTART_AFTER) {
+              game.restarted_at = now;
+              Sim::restart();
+              return;
+            }
+            idle = min(idle, RESTART_AFTER - (now - started_at));
+          }
+          if (index == 0 && game.struck_at == NEVER) {
+            if (now - started_at >= STRIKE_DELAY) {
+              PuzzleModule::strike();
+              game.struck_at = now;
+            } else {
+              idle = min(idle, STRIKE_DELAY - (now - started_at));
+            }
+          }
+          // Modules that brown out solve first, so the main module loses
+          // ones it already counted as solved.
+          unsigned long solve_delay =
+              game.browns_out[index] ? SOLVE_DELAY : game.solve_delay;
+          if (!needy && !solved) {
+            if (now - started_at >= solve_delay) {
+              PuzzleModule::solve();
+              solved = true;
+            } else {
+              idle = min(idle, solve_delay - (now - started_at));
+            }
+          }
+        }
+        if (game.idle)
+          Sim::idle(idle);
+      });
+}
+
+GameResult playGame(const Scenario &scenario, const String &transport_kind,
+                    uint32_t seed) {
+  Game game;
+  game.modules = scenario.puzzle_modules + scenario.needy_modules;
+  game.brownouts = scenario.brownouts;
+  game.solve_delay = scenario.solve_delay;
+  game.idle = transport_kind == "esp-now";
+  game.started_at.assign(game.modules, NEVER);
+  game.reset_seen_at.assign(game.modules, NEVER);
+  game.browns_out.assign(game.modules, false);
+  std::fill(game.browns_out.begin(), game.browns_out.begin() + game.brownouts,
+            true);
+  std::shuffle(game.browns_out.begin(), game.browns_out.end(),
+               std::mt19937(seed));
+  game.powered_off_at.assign(game.modules, NEVER);
+  if (scenario.replay)
+    game.vanishing = std::mt19937(seed)() % game.modules;
+  game.suspected_at.assign(game.modules, NEVER);
+  game.heartbeat_acks.assign(game.modules, 0);
+  if (scenario.restart)
+    game.restarting = 0;
+
+  std::vector<std::unique_ptr<Transport>> transports;
+  uint8_t mac[ESP_NOW_ETH_ALEN];
+  for (int i = 0; i <= game.modules; i++) {
+    macFor(i, mac);
+    transports.emplace_back(makeTransport(transport_kind, mac));
+  }
+  addMainModule(game, transports[0].get());
+  for (int i = 0; i < game.modules; i++)
+    addModule(game, i, i >= scenario.puzzle_modules, transports[i + 1].get());
+  if (game.restarting != -1) {
+    uint8_t restarting[ESP_NOW_ETH_ALEN];
+    macFor(game.restarting + 1, restarting);
+    Sim::setFrameFilter([&game, restarting](const uint8_t *src,
+                                            const uint8_t *data, size_t len) {
+      return game.restarted(game.restarting) && !game.reconnected &&
+             memcmp(src, restarting, ESP_NOW_ETH_ALEN) == 0 &&
+             carries(data, len, ANNOUNCE);
+    });
+  }
+
+  bool finished = Sim::runUntil(
+      [&game]() {
+        return game.vanishing != -1 ? game.replay_solved_at != NEVER
+                                    : game.resetSeen() != NEVER;
+      },
+      GAME_TIMEOUT);
+  GameResult result;
+  result.finished = finished;
+  result.discover = game.discovered_at;
+  result.undiscovered = game.modules - game.discovered;
+  result.start = since(latest(game.started_at), START_AFTER * 1000);
+  result.skew =
+      since(latest(game.started_at),
+            *std::min_element(game.started_at.begin(), game.started_at.end()));
+  result.strike = since(game.strike_counted_at, game.struck_at);
+  result.reset = since(game.resetSeen(), game.reset_at);
+  result.replay = since(game.replay_solved_at, game.reset_at);
+  result.detect = game.brownouts == 0 ? NEVER : 0;
+  for (int i = 0; i < game.modules; i++) {
+    if (!game.poweredOff(i))
+      continue;
+    unsigned long detect = since(game.suspected_at[i], game.powered_off_at[i]);
+    result.detect = detect == NEVER || result.detect == NEVER
+                        ? NEVER
+                        : max(result.detect, detect);
+  }
+  result.false_suspicions = game.false_suspicions;
+  const size_t frame = FRAME_HEADER_SIZE + MESSAGE_HEADER_SIZE;
+  result.heartbeat_airtime_us = game.heartbeats * Sim::airtimeUs(frame, false);
+  for (unsigned long acks : game.heartbeat_acks)
+    result.heartbeat_airtime_us +=
+        acks * Sim::airtimeUs(frame + HeartbeatAckWire::SIZE, true);
+  result.stats = Sim::stats();
+  result.allocations = Sim::allocations();
+  Sim::clear();
+  return result;
+}
+
+// Average and worst of one metric over the games that reached it.
+struct Summary {
+  unsigned long total = 0, worst = 0;
+  int count = 0;
+
+  void add(unsigned long value) {
+    if (value == NEVER)
+      return;
+    total += value;
+    worst = max(worst, value);
+    count++;
+  }
+
+  void print() const {
+    char cell[32] = "-";
+    if (count != 0)
+      snprintf(cell, sizeof(cell), "%lu/%lu", total / count, worst);
+    printf(" %13s", cell);
+  }
+};
+
+bool runScenario(const Scenario &scenario, int games, const String &transport) {
+  Summary discover, undiscovered, start, skew, strike, reset, detect,
+      false_suspicions, heartbeat, replay, airtime, frames, allocations;
+  int finished = 0;
+  auto begin = std::chrono::steady_clock::now();
+  for (int i = 0; i < games; i++) {
+    Sim::MediumConfig config = scenario.medium;
+    config.seed += i;
+    Sim::configure(config);
+    GameResult result = playGame(scenario, transport, config.seed);
+    finished += result.finished;
+    discover.add(result.discover);
+    undiscovered.add(result.undiscovered);
+    start.add(result.start);
+    skew.add(result.skew);
+    strike.add(result.strike);
+    reset.add(result.reset);
+    detect.add(result.detect);
+    false_suspicions.add(result.false_suspicions);
+    heartbeat.add(result.heartbeat_airtime_us / 1000);
+    replay.add(result.replay);
+    airtime.add(result.stats.airtime_us / 1000);
+    frames.add(result.stats.frames);
+    allocations.add(result.allocations);
+  }
+  double wall =
+      std::chrono::duration<double>(std::chrono::steady_clock::now() - begin)
+          .count();
+
+  char modules[24], finished_games[24];
+  snprintf(modules, sizeof(modules), "%d+%d", scenario.puzzle_modules,
+           scenario.needy_modules);
+  snprintf(finished_games, sizeof(finished_games), "%d/%d", finished, games);
+  printf("%-10s %7s %7s", scenario.name, modules, finished_games);
+  discover.print();
+  undiscovered.print();
+  start.print();
+  skew.print();
+  strike.print();
+  reset.print();
+  detect.print();
+  false_suspicions.print();
+  heartbeat.print();
+  replay.print();
+  airtime.print();
+  frames.print();
+  allocations.print();
+  printf(" %8.1f\n", wall * 1000 / games);
+  // The queue and UDP transports buffer frames on the heap themselves.
+  bool heap_free = transport != "esp-now" || allocations.worst == 0;
+  return finished == games && heap_free;
+}
+
+// Unit tests bring their own main().
+#ifndef PIO_UNIT_TESTING
+int main(int argc, char **argv) {
+  String name = argc > 1 ? argv[1] : "all";
+  int games = argc > 2 ? atoi(argv[2]) : 5;
+  String transport = argc > 3 ? argv[3] : "esp-now";
+
+  printf("transport: %s, times in ms as average/worst\n", transport.c_str());
+  printf("%-10s %7s %7s %13s %13s %13s %13s %13s %13s %13s %13s %13s %13s "
+         "%13s %13s %13s %8s\n",
+         "scenario", "modules", "games", "discover", "undiscovered", "start",
+         "skew", "strike", "reset", "detect", "suspected", "heartbeat",
+         "replay", "airtime", "frames", "allocs", "wall");
+  bool ok = true;
+  bool found = false;
+  for (const Scenario &scenario : SCENARIOS) {
+    if (name != "all" && name != scenario.name)
+      continue;
+    found = true;
+    ok = runScenario(scenario, games, transport) && ok;
+  }
+  if (!found) {
+    printf("unknown scenario %s\n", name.c_str());
+    return 2;
+  }
+  return ok ? 0 : 1;
+}
+#endif
@@ -0,0 +1,107 @@
+#ifndef SIM_NODE_H
+#define SIM_NODE_H
+
+#include <clock.h>
+#include <esp_now.h>
+#include <sim.h>
+
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <random>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace Sim {
+struct Frame {
+  uint8_t src[ESP_NOW_ETH_ALEN];
+  uint8_t dest[ESP_NOW_ETH_ALEN];
+  std::vector<uint8_t> data;
+};
+
+struct Event {
+  uint64_t at_us;
+  uint64_t order;
+  bool send_status;
+  esp_now_send_status_t status;
+  Frame frame;
+  bool operator>(const Event &other) const {
+    return at_us != other.at_us ? at_us > other.at_us : order > other.order;
+  }
+};
+
+// Hands the single simulated CPU from one thread to the next.
+struct Baton {
+  std::mutex mutex;
+  std::condition_variable cv;
+  bool ready = false;
+
+  void post() {
+    std::lock_guard<std::mutex> lock(mutex);
+    ready = true;
+    cv.notify_one();
+  }
+
+  void wait() {
+    std::unique_lock<std::mutex> lock(mutex);
+    cv.wait(lock, [this]() { return ready; });
+    ready = false;
+  }
+};
+
+struct Node {
+  int id;
+  uint8_t mac[ESP_NOW_ETH_ALEN];
+  Program setup, loop;
+  std::thread thread;
+  Baton baton;
+  bool set_up = false;
+  bool powered = true;
+  // Set by restart(): the thread ends after this tick and a new one runs the
+  // node from its setup, with fresh thread_local state.
+  bool restarting = false;
+  // Installed as the node's Clock source and moved to the simulated time
+  // before every tick.
+  Clock::Virtual clock;
+
+  std::mt19937 rng;
+  std::map<std::string, std::map<std::string, std::vector<uint8_t>>>
+      preferences;
+
+  bool esp_now_started = false;
+  esp_now_recv_cb_t recv_cb = nullptr;
+  esp_now_send_cb_t send_cb = nullptr;
+  std::set<uint64_t> peers;
+  unsigned tx_in_flight = 0;
+
+  std::vector<Event> inbox;
+  std::vector<Frame> outbox;
+  uint64_t wake_us = 0;
+  bool bad_channel = false;
+  // Heap allocations of the node's code after setup.
+  unsigned long allocations = 0;
+};
+
+// Counts the heap allocations of the calling thread into `counter` from now
+// on, or stops counting when it is null.
+void countAllocations(unsigned long *counter);
+
+// Leaves what the simulated platform allocates on a node's behalf, like the
+// radio queues or the flash storage, out of the node's count while in scope.
+struct PlatformHeap {
+  PlatformHeap();
+  ~PlatformHeap();
+
+private:
+  unsigned long *_saved;
+};
+
+uint64_t macToKey(const uint8_t *mac);
+Node *currentNode();
+const MediumConfig &config();
+uint64_t nowMicros();
+} // namespace Sim
+
+#endif // SIM_NODE_H
@@ -0,0 +1,12 @@
+#include <ota.h>
+
+// Simulated nodes never enter OTA mode: there is no web server on the host.
+namespace OTA {
+bool shouldStart() { return false; }
+
+void update() {}
+
+void start(String version, String name) {}
+
+bool running() { return false; }
+}; // namespace OTA
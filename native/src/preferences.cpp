@@ -0,0 +1,98 @@
+#include <Preferences.h>
+
+#include "node.h"
+
+// The maps stand in for the flash, their allocations are left out of the
+// node's count.
+namespace {
+std::map<std::string, std::vector<uint8_t>> &storage(const String &name) {
+  return Sim::currentNode()->preferences[name.c_str()];
+}
+} // namespace
+
+bool Preferences::begin(const char *name, bool read_only) {
+  Sim::PlatformHeap heap;
+  _namespace = name;
+  _read_only = read_only;
+  _started = true;
+  return true;
+}
+
+void Preferences::end() { _started = false; }
+
+bool Preferences::clear() {
+  Sim::PlatformHeap heap;
+  if (!_started || _read_only)
+    return false;
+  storage(_namespace).clear();
+  return true;
+}
+
+bool Preferences::remove(const char *key) {
+  Sim::PlatformHeap heap;
+  if (!_started || _read_only)
+    return false;
+  return storage(_namespace).erase(key) != 0;
+}
+
+bool Preferences::isKey(const char *key) {
+  return _started && storage(_namespace).count(key) != 0;
+}
+
+size_t Preferences::putBytes(const char *key, const void *value, size_t len) {
+  Sim::PlatformHeap heap;
+  if (!_started || _read_only || key == nullptr)
+    return 0;
+  const uint8_t *bytes = (const uint8_t *)value;
+  storage(_namespace)[key].assign(bytes, bytes + len);
+  return len;
+}
+
+size_t Preferences::putInt(const char *key, int32_t value) {
+  return putBytes(key, &value, sizeof(value));
+}
+
+size_t Preferences::putUInt(const char *key, uint32_t value) {
+  return putBytes(key, &value, sizeof(value));
+}
+
+size_t Preferences::putString(const char *key, const String &value) {
+  return putBytes(key, value.c_str(), value.length() + 1);
+}
+
+size_t Preferences::getBytesLength(const char *key) {
+  Sim::PlatformHeap heap;
+  if (!isKey(key))
+    return 0;
+  return storage(_namespace)[key].size();
+}
+
+size_t Preferences::getBytes(const char *key, void *buf, size_t max_len) {
+  Sim::PlatformHeap heap;
+  size_t len = getBytesLength(key);
+  if (len == 0 || len > max_len)
+    return 0;
+  memcpy(buf, storage(_namespace)[key].data(), len);
+  return len;
+}
+
+int32_t Preferences::getInt(const char *key, int32_t default_value) {
+  int32_t value;
+  if (getBytes(key, &value, sizeof(value)) != sizeof(value))
+    return default_value;
+  return value;
+}
+
+uint32_t Preferences::getUInt(const char *key, uint32_t default_value) {
+  uint32_t value;
+  if (getBytes(key, &value, sizeof(value)) != sizeof(value))
+    return default_value;
+  return value;
+}
+
+String Preferences::getString(const char *key, const String &default_value) {
+  size_t len = getBytesLength(key);
+  if (len == 0)
+    return default_value;
+  return String((const char *)storage(_namespace)[key].data());
+}
@@ -0,0 +1,76 @@
+#include <WiFi.h>
+#include <algorithm>
+#include <queue_transport.h>
+
+namespace {
+const size_t MAX_QUEUED_FRAMES = 64;
+
+std::mutex _bus_mutex;
+std::vector<QueueTransport *> _bus;
+} // namespace
+
+QueueTransport::QueueTransport() { WiFi.macAddress(_mac); }
+
+QueueTransport::QueueTransport(const uint8_t *mac) { memcpy(_mac, mac, 6); }
+
+QueueTransport::~QueueTransport() {
+  std::lock_guard<std::mutex> lock(_bus_mutex);
+  _bus.erase(std::remove(_bus.begin(), _bus.end(), this), _bus.end());
+}
+
+bool QueueTransport::begin(TransportRecv recv, TransportSent sent) {
+  _recv = recv;
+  _sent = sent;
+  std::lock_guard<std::mutex> lock(_bus_mutex);
+  if (std::find(_bus.begin(), _bus.end(), this) == _bus.end())
+    _bus.push_back(this);
+  return true;
+}
+
+void QueueTransport::push(const uint8_t *mac, const uint8_t *data, size_t len) {
+  std::lock_guard<std::mutex> lock(_mutex);
+  if (_queue.size() >= MAX_QUEUED_FRAMES)
+    return;
+  Frame frame;
+  memcpy(frame.mac, mac, 6);
+  frame.data.assign(data, data + len);
+  _queue.push_back(frame);
+}
+
+void QueueTransport::macAddress(uint8_t *mac) { memcpy(mac, _mac, 6); }
+
+esp_err_t QueueTransport::send(const uint8_t *mac, const uint8_t *data,
+                               size_t len) {
+  if (len > (size_t)MAX_FRAME_SIZE)
+    return ESP_ERR_INVALID_ARG;
+  bool broadcast = memcmp(mac, BROADCAST_ADDRESS, 6) == 0;
+  // Like an unacked ESP-NOW unicast, one to a MAC nobody has fails.
+  bool delivered = broadcast;
+  {
+    std::lock_guard<std::mutex> lock(_bus_mutex);
+    for (QueueTransport *transport : _bus)
+      if (transport != this &&
+          (broadcast || memcmp(transport->_mac, mac, 6) == 0)) {
+        transport->push(_mac, data, len);
+        delivered = true;
+      }
+  }
+  if (_sent != nullptr)
+    _sent(mac, delivered);
+  return ESP_OK;
+}
+
+void QueueTransport::poll() {
+  while (true) {
+    Frame frame;
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      if (_queue.empty())
+        return;
+      frame = std::move(_queue.front());
+      _queue.pop_front();
+    }
+    if (_recv != nullptr)
+      _recv(frame.mac, frame.data.data(), frame.data.size());
+  }
+}
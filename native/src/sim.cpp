@@ -0,0 +1,324 @@
+#include <algorithm>
+#include <cstring>
+#include <memory>
+
+#include "node.h"
+
+namespace Sim {
+const uint8_t BROADCAST_MAC[ESP_NOW_ETH_ALEN] = {0xff, 0xff, 0xff,
+                                                 0xff, 0xff, 0xff};
+
+MediumConfig _config;
+MediumStats _stats;
+std::mt19937 _rng;
+uint64_t _now_us = 0;
+uint64_t _event_order = 0;
+uint64_t _channel_free_us = 0;
+std::vector<std::unique_ptr<Node>> _nodes;
+FrameFilter _filter;
+
+Baton _harness;
+bool _stopping = false;
+
+thread_local Node *_current = nullptr;
+
+uint64_t macToKey(const uint8_t *mac) {
+  uint64_t key = 0;
+  for (int i = 0; i < ESP_NOW_ETH_ALEN; i++)
+    key = (key << 8) | mac[i];
+  return key;
+}
+
+Node *currentNode() { return _current; }
+
+const MediumConfig &config() { return _config; }
+
+uint64_t nowMicros() { return _now_us; }
+
+unsigned long now() { return _now_us / 1000; }
+
+MediumStats stats() { return _stats; }
+
+unsigned long allocations() {
+  unsigned long allocations = 0;
+  for (auto &node : _nodes)
+    allocations += node->allocations;
+  return allocations;
+}
+
+void idle(unsigned long ms) {
+  Node *node = currentNode();
+  node->wake_us = std::max(node->wake_us, _now_us + (uint64_t)ms * 1000);
+}
+
+void powerOff() {
+  Node *node = currentNode();
+  node->powered = false;
+  node->esp_now_started = false;
+  node->inbox.clear();
+}
+
+void restart() {
+  Node *node = currentNode();
+  node->restarting = true;
+  node->esp_now_started = false;
+  node->recv_cb = nullptr;
+  node->send_cb = nullptr;
+  node->peers.clear();
+  node->tx_in_flight = 0;
+  node->inbox.clear();
+  node->outbox.clear();
+}
+
+void setFrameFilter(FrameFilter drop) { _filter = drop; }
+
+void configure(MediumConfig config) {
+  _config = config;
+  _rng.seed(config.seed);
+}
+
+void deliver(Node &node, Event event) {
+  event.order = _event_order++;
+  node.inbox.push_back(event);
+  std::push_heap(node.inbox.begin(), node.inbox.end(), std::greater<Event>());
+}
+
+void runTick(Node &node) {
+  if (!node.powered) {
+    node.wake_us = UINT64_MAX;
+    return;
+  }
+  node.clock.set(_now_us / 1000);
+  node.wake_us = _now_us + _config.tick_us;
+  if (!node.set_up) {
+    node.set_up = true;
+    node.setup();
+  }
+  countAllocations(&node.allocations);
+  while (!node.inbox.empty() && node.inbox.front().at_us <= _now_us) {
+    std::pop_heap(node.inbox.begin(), node.inbox.end(), std::greater<Event>());
+    Event event = std::move(node.inbox.back());
+    node.inbox.pop_back();
+    if (event.send_status)
+      node.tx_in_flight--;
+    if (event.send_status && node.send_cb != nullptr)
+      node.send_cb(event.frame.dest, event.status);
+    if (!event.send_status && node.recv_cb != nullptr)
+      node.recv_cb(event.frame.src, event.frame.data.data(),
+                   event.frame.data.size());
+  }
+  node.loop();
+  countAllocations(nullptr);
+}
+
+// Nodes run one after the other: each tick the harness hands the baton to the
+// first node and every node passes it on to the next one.
+void nodeThread(Node *node) {
+  _current = node;
+  Clock::setSource(&node->clock);
+  while (true) {
+    node->baton.wait();
+    if (_stopping)
+      return;
+    runTick(*node);
+    if (node->id + 1 < (int)_nodes.size())
+      _nodes[node->id + 1]->baton.post();
+    else
+      _harness.post();
+    if (node->restarting)
+      return;
+  }
+}
+
+// Replaces the threads of the nodes that restarted during the last tick.
+void restartNodes() {
+  for (auto &node : _nodes) {
+    if (!node->restarting)
+      continue;
+    node->thread.join();
+    node->restarting = false;
+    node->set_up = false;
+    node->thread = std::thread(nodeThread, node.get());
+  }
+}
+
+int addNode(const uint8_t *mac, Program setup, Program loop) {
+  std::unique_ptr<Node> node(new Node());
+  node->id = _nodes.size();
+  memcpy(node->mac, mac, ESP_NOW_ETH_ALEN);
+  node->setup = setup;
+  node->loop = loop;
+  node->rng.seed(_config.seed ^ (uint32_t)macToKey(mac));
+  node->thread = std::thread(nodeThread, node.get());
+  _nodes.push_back(std::move(node));
+  return _nodes.size() - 1;
+}
+
+bool isBroadcast(const uint8_t *mac) {
+  return memcmp(mac, BROADCAST_MAC, ESP_NOW_ETH_ALEN) == 0;
+}
+
+// 802.11b timings of an ESP-NOW action frame at 1 Mbps with a long preamble.
+const uint64_t PREAMBLE_US = 192;
+const uint64_t FRAME_OVERHEAD = 43;
+const uint64_t ACK_US = PREAMBLE_US + 14 * 8;
+const uint64_t SIFS_US = 10;
+const uint64_t DIFS_US = 50;
+const uint64_t SLOT_US = 20;
+const int CONTENTION_SLOTS = 32;
+
+uint64_t airtimeUs(size_t bytes, bool unicast) {
+  uint64_t airtime_us = PREAMBLE_US + (FRAME_OVERHEAD + bytes) * 8;
+  return unicast ? airtime_us + SIFS_US + ACK_US : airtime_us;
+}
+
+uint64_t airtime(const Frame &frame) {
+  return airtimeUs(frame.data.size(), false);
+}
+
+bool lost(Node &receiver) {
+  std::uniform_real_distribution<double> chance(0, 1);
+  double change =
+      receiver.bad_channel ? _config.burst_end : _config.burst_start;
+  if (chance(_rng) < change)
+    receiver.bad_channel = !receiver.bad_channel;
+  return chance(_rng) <
+         (receiver.bad_channel ? _config.burst_loss : _config.loss);
+}
+
+// Hands `frame` to its receivers once it is off the air at `end_us`.
+void route(Node &sender, Frame &frame, uint64_t end_us, bool collided) {
+  _stats.frames++;
+  _stats.bytes += frame.data.size();
+  uint64_t earliest_us = _now_us + _config.tick_us;
+  bool broadcast = isBroadcast(frame.dest);
+  bool filtered =
+      _filter && _filter(sender.mac, frame.data.data(), frame.data.size());
+  bool acked = false;
+  std::uniform_int_distribution<unsigned long> jitter(0, _config.jitter_us);
+  for (auto &node : _nodes) {
+    if (node.get() == &sender || !node->esp_now_started)
+      continue;
+    if (!broadcast && memcmp(node->mac, frame.dest, ESP_NOW_ETH_ALEN) != 0)
+      continue;
+    if (collided) {
+      _stats.collided++;
+      continue;
+    }
+    if (filtered || lost(*node)) {
+      _stats.dropped++;
+      continue;
+    }
+    _stats.delivered++;
+    acked = true;
+    uint64_t at_us = end_us + _config.latency_us + jitter(_rng);
+    deliver(*node, Event{std::max(at_us, earliest_us), 0, false,
+                         ESP_NOW_SEND_SUCCESS, frame});
+  }
+  if (acked && !broadcast) {
+    _stats.airtime_us += SIFS_US + ACK_US;
+    end_us += SIFS_US + ACK_US;
+  }
+  esp_now_send_status_t status =
+      broadcast || acked ? ESP_NOW_SEND_SUCCESS : ESP_NOW_SEND_FAIL;
+  deliver(sender, Event{std::max(end_us + _config.latency_us, earliest_us), 0,
+                        true, status, frame});
+}
+
+// Puts the frames of this tick on the air. Every frame draws a backoff slot
+// once the channel is free, a sender's later frames counting from its
+// previous one; frames go out in slot order and frames sharing a slot collide.
+void transmit() {
+  struct Transmission {
+    Node *sender;
+    Frame *frame;
+    int slot;
+  };
+  std::vector<Transmission> transmissions;
+  std::uniform_int_distribution<int> backoff(0, CONTENTION_SLOTS - 1);
+  for (auto &node : _nodes) {
+    int slot = -1;
+    for (auto &frame : node->outbox) {
+      slot += 1 + backoff(_rng);
+      transmissions.push_back({node.get(), &frame, slot});
+    }
+  }
+  if (!_config.collisions) {
+    for (auto &t : transmissions) {
+      _stats.airtime_us += airtime(*t.frame);
+      route(*t.sender, *t.frame, _now_us, false);
+    }
+    return;
+  }
+  std::stable_sort(transmissions.begin(), transmissions.end(),
+                   [](const Transmission &a, const Transmission &b) {
+                     return a.slot < b.slot;
+                   });
+  uint64_t free_us = std::max(_channel_free_us, _now_us);
+  for (size_t i = 0; i < transmissions.size();) {
+    size_t end = i + 1;
+    while (end < transmissions.size() &&
+           transmissions[end].slot == transmissions[i].slot)
+      end++;
+    bool collided = end - i > 1;
+    uint64_t start_us = free_us + DIFS_US + transmissions[i].slot * SLOT_US;
+    uint64_t busy_us = 0;
+    for (size_t k = i; k < end; k++)
+      busy_us = std::max(busy_us, airtime(*transmissions[k].frame));
+    _stats.airtime_us += busy_us;
+    for (size_t k = i; k < end; k++)
+      route(*transmissions[k].sender, *transmissions[k].frame,
+            start_us + busy_us, collided);
+    free_us = start_us + busy_us;
+    i = end;
+  }
+  _channel_free_us = free_us;
+}
+
+void step() {
+  if (!_nodes.empty()) {
+    _nodes[0]->baton.post();
+    _harness.wait();
+    restartNodes();
+  }
+  transmit();
+  uint64_t next_us = UINT64_MAX;
+  for (auto &node : _nodes) {
+    node->outbox.clear();
+    next_us = std::min(next_us, node->wake_us);
+    if (!node->inbox.empty())
+      next_us = std::min(next_us, node->inbox.front().at_us);
+  }
+  uint64_t tick_us = _config.tick_us;
+  next_us = std::max(next_us, _now_us + tick_us);
+  if (next_us == UINT64_MAX)
+    next_us = _now_us + tick_us;
+  _now_us = (next_us + tick_us - 1) / tick_us * tick_us;
+}
+
+bool runUntil(std::function<bool()> done, unsigned long timeout_ms) {
+  uint64_t deadline = _now_us + (uint64_t)timeout_ms * 1000;
+  while (_now_us < deadline) {
+    step();
+    if (done())
+      return true;
+  }
+  return false;
+}
+
+void clear() {
+  _stopping = true;
+  for (auto &node : _nodes)
+    node->baton.post();
+  for (auto &node : _nodes)
+    node->thread.join();
+  _nodes.clear();
+  _filter = nullptr;
+  _stopping = false;
+  _now_us = 0;
+  _event_order = 0;
+  _channel_free_us = 0;
+  _stats = MediumStats();
+  _rng.seed(_config.seed);
+}
+} // namespace Sim
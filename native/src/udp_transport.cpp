@@ -0,0 +1,106 @@
+#include <WiFi.h>
+#include <errno.h>
+#include <udp_transport.h>
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace {
+const size_t HEADER_SIZE = 12;
+} // namespace
+
+UdpTransport::UdpTransport(const char *group, uint16_t port)
+    : _has_mac(false), _group(group), _port(port) {}
+
+UdpTransport::UdpTransport(const uint8_t *mac, const char *group, uint16_t port)
+    : _has_mac(true), _group(group), _port(port) {
+  memcpy(_mac, mac, 6);
+}
+
+UdpTransport::~UdpTransport() {
+  if (_socket >= 0)
+    close(_socket);
+}
+
+bool UdpTransport::begin(TransportRecv recv, TransportSent sent) {
+  if (!_has_mac)
+    WiFi.macAddress(_mac);
+  _recv = recv;
+  _sent = sent;
+  _socket = socket(AF_INET, SOCK_DGRAM, 0);
+  if (_socket < 0)
+    return false;
+
+  int enable = 1;
+  setsockopt(_socket, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+#ifdef SO_REUSEPORT
+  setsockopt(_socket, SOL_SOCKET, SO_REUSEPORT, &enable, sizeof(enable));
+#endif
+
+  struct sockaddr_in address = {};
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = htonl(INADDR_ANY);
+  address.sin_port = htons(_port);
+  if (bind(_socket, (struct sockaddr *)&address, sizeof(address)) < 0)
+    return false;
+
+  struct ip_mreq membership = {};
+  membership.imr_multiaddr.s_addr = inet_addr(_group);
+  membership.imr_interface.s_addr = htonl(INADDR_ANY);
+  if (setsockopt(_socket, IPPROTO_IP, IP_ADD_MEMBERSHIP, &membership,
+                 sizeof(membership)) < 0)
+    return false;
+  uint8_t loop = 1;
+  setsockopt(_socket, IPPROTO_IP, IP_MULTICAST_LOOP, &loop, sizeof(loop));
+
+  return fcntl(_socket, F_SETFL, fcntl(_socket, F_GETFL, 0) | O_NONBLOCK) >= 0;
+}
+
+void UdpTransport::macAddress(uint8_t *mac) { memcpy(mac, _mac, 6); }
+
+esp_err_t UdpTransport::send(const uint8_t *mac, const uint8_t *data,
+                             size_t len) {
+  if (_socket < 0)
+    return ESP_FAIL;
+  if (len > (size_t)MAX_FRAME_SIZE)
+    return ESP_ERR_INVALID_ARG;
+  uint8_t datagram[HEADER_SIZE + MAX_FRAME_SIZE];
+  memcpy(datagram, _mac, 6);
+  memcpy(datagram + 6, mac, 6);
+  memcpy(datagram + HEADER_SIZE, data, len);
+
+  struct sockaddr_in address = {};
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = inet_addr(_group);
+  address.sin_port = htons(_port);
+  if (sendto(_socket, datagram, HEADER_SIZE + len, 0,
+             (struct sockaddr *)&address, sizeof(address)) < 0)
+    return errno == EAGAIN || errno == EWOULDBLOCK || errno == ENOBUFS
+               ? ESP_ERR_NO_MEM
+               : ESP_FAIL;
+  // UDP has no acknowledgement to wait for.
+  if (_sent != nullptr)
+    _sent(mac, true);
+  return ESP_OK;
+}
+
+void UdpTransport::poll() {
+  if (_socket < 0)
+    return;
+  uint8_t datagram[HEADER_SIZE + MAX_FRAME_SIZE];
+  while (true) {
+    int len = recv(_socket, datagram, sizeof(datagram), 0);
+    if (len <= (int)HEADER_SIZE)
+      return;
+    if (memcmp(datagram, _mac, 6) == 0)
+      continue;
+    if (memcmp(datagram + 6, _mac, 6) != 0 &&
+        memcmp(datagram + 6, BROADCAST_ADDRESS, 6) != 0)
+      continue;
+    if (_recv != nullptr)
+      _recv(datagram, datagram + HEADER_SIZE, len - HEADER_SIZE);
+  }
+}
@@ -0,0 +1,20 @@
+#include <WiFi.h>
+
+#include "node.h"
+
+WiFiClass WiFi;
+
+bool WiFiClass::mode(wifi_mode_t mode) { return true; }
+
+String WiFiClass::macAddress() {
+  const uint8_t *mac = Sim::currentNode()->mac;
+  char result[18];
+  snprintf(result, sizeof(result), "%02X:%02X:%02X:%02X:%02X:%02X", mac[0],
+           mac[1], mac[2], mac[3], mac[4], mac[5]);
+  return String(result);
+}
+
+uint8_t *WiFiClass::macAddress(uint8_t *mac) {
+  memcpy(mac, Sim::currentNode()->mac, ESP_NOW_ETH_ALEN);
+  return mac;
+}
@@ -1,16 +1,83 @@
 #include <bomb_protocol.h>
 #include <ota.h>
+#include <peer_table.h>
+#include <stats.h>
+#include <transport/esp_now_transport.h>
+#include <utils/ring_buffer.h>
 
-String _module_name = "Unknown";
+NODE_LOCAL const char *_module_name = "Unknown";
 
-Callbacks _callbacks;
-ModuleType _type;
-bool _started = false;
+NODE_LOCAL const MessageHandler *_handlers;
+NODE_LOCAL FrameHandler _frame;
+NODE_LOCAL FrameSentHandler _frame_sent;
+NODE_LOCAL uint16_t _epoch;
+NODE_LOCAL ModuleType _type;
+NODE_LOCAL bool _started = false;
+NODE_LOCAL uint8_t _mac_address[MAC_ADDRESS_SIZE];
+
+NODE_LOCAL EspNowTransport _esp_now_transport;
+NODE_LOCAL Transport *_transport = &_esp_now_transport;
+
+typedef struct ReceivedFrame {
+  unsigned long received_at;
+  uint8_t mac[6];
+  uint8_t len;
+  uint8_t data[MAX_FRAME_SIZE];
+} ReceivedFrame;
+
+NODE_LOCAL RingBuffer<ReceivedFrame, RECEIVE_QUEUE_SIZE> _received_frames;
+NODE_LOCAL unsigned long _frame_received_at;
+
+typedef struct PendingFrame {
+  uint8_t mac[6];
+  bool addressed;
+  uint8_t header_len;
+  uint8_t len;
+  uint8_t data[MAX_FRAME_SIZE];
+} PendingFrame;
+
+NODE_LOCAL PendingFrame _pending_frames[MAX_PENDING_FRAMES];
+NODE_LOCAL int _pending_frames_count = 0;
+
+// Flushed frames live in _tx_frames until the transport reports them sent.
+// Their slots wait in one lane per traffic class until a frame is handed to
+// the transport, then in _tx_in_flight, in the order the transport completes
+// them. Reports arrive through _tx_reports, possibly from another task.
+using FrameSlots = RingBuffer<uint8_t, TX_QUEUE_SIZE>;
+
+NODE_LOCAL PendingFrame _tx_frames[TX_QUEUE_SIZE];
+NODE_LOCAL FrameSlots _tx_free;
+NODE_LOCAL FrameSlots _tx_lanes[TRAFFIC_CLASSES];
+NODE_LOCAL FrameSlots _tx_in_flight;
+NODE_LOCAL RingBuffer<bool, TX_QUEUE_SIZE> _tx_reports;
+// The frame whose report the FrameSentHandler is handling.
+NODE_LOCAL const PendingFrame *_sent_frame;
+
+// Token buckets of the rate limited classes, in thousandths of a frame.
+const unsigned long FRAME_RATES[TRAFFIC_CLASSES] = {0, CONTROL_FRAME_RATE,
+                                                    BACKGROUND_FRAME_RATE};
+const unsigned long MAX_TOKENS = FRAME_BURST * 1000;
+const size_t CRITICAL_TX_SLOTS = TX_QUEUE_SIZE / 4;
+NODE_LOCAL unsigned long _tx_tokens[TRAFFIC_CLASSES];
+NODE_LOCAL unsigned long _tx_tokens_updated_at;
+
+NODE_LOCAL TimerWheel _timers;
+
+// Peers the transport had no unicast slot for.
+NODE_LOCAL PeerTable<MAX_PEERS> _addressed_peers;
 
 void onDataRecv(const uint8_t *mac, const uint8_t *incoming_data, int len);
-MessageType getMessageInfo(const uint8_t *incoming_data, int len);
+void onDataSent(const uint8_t *mac, bool delivered);
+void completeSentFrames();
+void sendTxFrames();
+void handleFrame(const uint8_t *mac, const uint8_t *incoming_data, int len);
+void handleMessage(const uint8_t *mac, const uint8_t *message, int len);
 
-bool initProtocol(String module_name, Callbacks callbacks, ModuleType type) {
+void setTransport(Transport *transport) { _transport = transport; }
+
+bool initProtocol(const char *module_name, const MessageHandler *handlers,
+                  FrameHandler frame, FrameSentHandler frame_sent,
+                  ModuleType type) {
   if (DEBUG) {
     Serial.begin(BAUD_RATE);
     Serial.println("Initializing protocol");
@@ -23,217 +90,469 @@ bool initProtocol(String module_name, Callbacks callbacks, ModuleType type) {
     return true;
   }
 
-  _callbacks = callbacks;
+  _handlers = handlers;
+  _frame = frame;
+  _frame_sent = frame_sent;
+  for (int i = 0; i < TX_QUEUE_SIZE; i++) {
+    *_tx_free.reserve() = i;
+    _tx_free.push();
+  }
+  for (int i = 0; i < TRAFFIC_CLASSES; i++)
+    _tx_tokens[i] = MAX_TOKENS;
+  _tx_tokens_updated_at = Clock::millis();
   _type = type;
-  WiFi.mode(WIFI_STA);
-  if (esp_now_init() != ESP_OK)
+  if (!_transport->begin(onDataRecv, onDataSent))
     return false;
+  _transport->macAddress(_mac_address);
   if (DEBUG)
-    Serial.println("ESP Now initialized");
+    Serial.println("Transport initialized");
   _started = true;
-  esp_now_register_recv_cb(onDataRecv);
   return true;
 }
 
-bool tryConnectingToPeer(const uint8_t *mac, esp_now_peer_info_t *peer) {
-  memcpy(peer->peer_addr, mac, 6);
-  peer->channel = 0;
-  peer->encrypt = false;
-  if (esp_now_add_peer(peer) != ESP_OK)
-    return false;
-  return true;
-}
-
-void onBombInfoRecv(const uint8_t *mac, const uint8_t *incoming_data, int len) {
-  if (_callbacks.bombInfoCallback == nullptr)
+void updateProtocol() {
+  if (!_started)
     return;
-  BombInfo info;
-  memcpy(&info, incoming_data + 1, sizeof(info));
-  _callbacks.bombInfoCallback(info);
+  _transport->poll();
+  completeSentFrames();
+  sendTxFrames();
+  for (int i = 0; i < RECEIVE_QUEUE_SIZE; i++) {
+    ReceivedFrame *frame = _received_frames.peek();
+    if (frame == nullptr)
+      break;
+    _frame_received_at = frame->received_at;
+    handleFrame(frame->mac, frame->data, frame->len);
+    _received_frames.pop();
+  }
+  _timers.run(Clock::millis());
 }
 
-void onBombInfoRequestRecv(const uint8_t *mac, const uint8_t *incoming_data,
-                           int len) {
-  if (_callbacks.bombInfoRequestCallback == nullptr)
-    return;
-  BombInfoRequest info;
-  memcpy(&info, incoming_data + 1, sizeof(info));
-  _callbacks.bombInfoRequestCallback(info, mac);
+void startTimer(Timer &timer, unsigned long delay, unsigned long period) {
+  _timers.start(timer, Clock::millis(), delay, period);
 }
 
-void onSolveAttemptRecv(const uint8_t *mac, const uint8_t *incoming_data,
-                        int len) {
-  if (_callbacks.solveAttemptCallback == nullptr)
-    return;
-  SolveAttempt info;
-  memcpy(&info, incoming_data + 1, sizeof(info));
-  _callbacks.solveAttemptCallback(info, mac);
-}
+void stopTimer(Timer &timer) { _timers.stop(timer); }
 
-void onSolveAttemptAckRecv(const uint8_t *mac, const uint8_t *incoming_data,
-                           int len) {
-  if (_callbacks.solveAttemptAckCallback == nullptr)
-    return;
-  SolveAttemptAck info;
-  memcpy(&info, incoming_data + 1, sizeof(info));
-  _callbacks.solveAttemptAckCallback(info);
+unsigned long jitter(unsigned long delay) {
+  unsigned long spread = delay / 2;
+  return delay - delay / 4 + (spread == 0 ? 0 : esp_random() % (spread + 1));
 }
 
-void onConnectionInfoRecv(const uint8_t *mac, const uint8_t *incoming_data,
-                          int len) {
-  if (_callbacks.connectionCallback == nullptr)
-    return;
-  Connection info;
-  memcpy(&info, incoming_data + 1, sizeof(info));
-  _callbacks.connectionCallback(info, mac);
+int ackSlots(int modules) { return modules > 0 ? modules : ACK_DEFAULT_SLOTS; }
+
+unsigned long ackWindow(int slots) { return slots * ACK_SLOT; }
+
+unsigned long ackSlotStart(const uint8_t *mac, int slots) {
+  return (macHash(mac) >> 32) % slots * ACK_SLOT;
 }
 
-void onStartRecv(const uint8_t *mac, const uint8_t *incoming_data, int len) {
-  if (_callbacks.startCallback == nullptr)
-    return;
-  _callbacks.startCallback();
+unsigned long ackDelay(int slots) {
+  return ackSlotStart(_mac_address, slots) + esp_random() % ACK_SLOT;
 }
 
-void onStartAckRecv(const uint8_t *mac, const uint8_t *incomingData, int len) {
-  if (_callbacks.startAckCallback == nullptr)
-    return;
-  _callbacks.startAckCallback(mac);
+unsigned long idleTime(unsigned long max_idle) {
+  if (_received_frames.size() != 0 || _tx_reports.size() != 0 ||
+      _pending_frames_count != 0)
+    return 0;
+  for (int i = 0; i < TRAFFIC_CLASSES; i++)
+    if (_tx_lanes[i].size() != 0)
+      return 0;
+  unsigned long deadline;
+  if (!_timers.nextDeadline(deadline))
+    return max_idle;
+  long idle = (long)(deadline - Clock::millis());
+  if (idle <= 0)
+    return 0;
+  return (unsigned long)idle < max_idle ? idle : max_idle;
 }
 
-void onResetRecv(const uint8_t *mac, const uint8_t *incoming_data, int len) {
-  if (_callbacks.resetCallback == nullptr)
+unsigned long frameReceivedAt() { return _frame_received_at; }
+
+void setEpoch(uint16_t epoch) {
+  if (epoch == _epoch)
     return;
-  _callbacks.resetCallback();
+  _epoch = epoch;
+  _pending_frames_count = 0;
+  for (int i = 0; i < TRAFFIC_CLASSES; i++) {
+    for (uint8_t *slot; (slot = _tx_lanes[i].peek()) != nullptr;) {
+      *_tx_free.reserve() = *slot;
+      _tx_free.push();
+      _tx_lanes[i].pop();
+    }
+  }
 }
 
-void onResetAckRecv(const uint8_t *mac, const uint8_t *incoming_data, int len) {
-  if (_callbacks.resetAckCallback == nullptr)
-    return;
-  _callbacks.resetAckCallback(mac);
+uint16_t epoch() { return _epoch; }
+
+bool staleEpoch(uint16_t frame_epoch) {
+  int16_t behind = _epoch - frame_epoch;
+  return behind > 0 && behind <= STALE_EPOCHS;
 }
 
-void onHeartbeatRecv(const uint8_t *mac, const uint8_t *incoming_data,
-                     int len) {
-  send(HEARTBEAT_ACK, _type, mac);
+template <typename F> void forEachMessage(const PendingFrame &frame, F f) {
+  for (int i = frame.header_len; i < frame.len; i += frame.data[i] + 1)
+    f((MessageType)frame.data[i + 1]);
 }
 
-void onHeartbeatAckRecv(const uint8_t *mac, const uint8_t *incoming_data,
-                        int len) {
-  ModuleType type = (ModuleType)incoming_data[1];
-  if (_callbacks.heartbeatAckCallback == nullptr)
-    return;
-  _callbacks.heartbeatAckCallback(type, mac);
+bool sentFrameCarries(MessageType type) {
+  bool carries = false;
+  if (_sent_frame != nullptr)
+    forEachMessage(*_sent_frame, [&](MessageType message) {
+      carries = carries || message == type;
+    });
+  return carries;
 }
 
-void onDataRecv(const uint8_t *mac, const uint8_t *incoming_data, int len) {
-  MessageType type = getMessageInfo(incoming_data, len);
+TrafficClass trafficClass(MessageType type) {
   switch (type) {
-  case CONNECTION:
-    onConnectionInfoRecv(mac, incoming_data, len);
-    break;
-  case BOMB_INFO:
-    onBombInfoRecv(mac, incoming_data, len);
-    break;
-  case BOMB_INFO_REQUEST:
-    onBombInfoRequestRecv(mac, incoming_data, len);
-    break;
   case SOLVE_ATTEMPT:
-    onSolveAttemptRecv(mac, incoming_data, len);
-    break;
   case SOLVE_ATTEMPT_ACK:
-    onSolveAttemptAckRecv(mac, incoming_data, len);
-    break;
-  case START:
-    onStartRecv(mac, incoming_data, len);
-    break;
-  case START_ACK:
-    onStartAckRecv(mac, incoming_data, len);
-    break;
   case RESET:
-    onResetRecv(mac, incoming_data, len);
-    break;
   case RESET_ACK:
-    onResetAckRecv(mac, incoming_data, len);
-    break;
-  case HEARTBEAT:
-    onHeartbeatRecv(mac, incoming_data, len);
-    break;
-  case HEARTBEAT_ACK:
-    onHeartbeatAckRecv(mac, incoming_data, len);
-    break;
-  default:
-    break;
-  }
-}
-
-MessageType getMessageInfo(const uint8_t *incoming_data, int len) {
-  uint8_t type = incoming_data[0];
-  switch (type) {
-  case CONNECTION:
-    return CONNECTION;
+    return CRITICAL;
   case BOMB_INFO:
-    return BOMB_INFO;
   case BOMB_INFO_REQUEST:
-    return BOMB_INFO_REQUEST;
-  case SOLVE_ATTEMPT:
-    return SOLVE_ATTEMPT;
-  case SOLVE_ATTEMPT_ACK:
-    return SOLVE_ATTEMPT_ACK;
   case START:
-    return START;
   case START_ACK:
-    return START_ACK;
-  case RESET:
-    return RESET;
-  case RESET_ACK:
-    return RESET_ACK;
-  case HEARTBEAT:
-    return HEARTBEAT;
-  case HEARTBEAT_ACK:
-    return HEARTBEAT_ACK;
+    return CONTROL;
   default:
-    return UNKNOWN;
+    return BACKGROUND;
   }
 }
 
-esp_err_t send(MessageType type, const uint8_t *mac) {
-  if (!_started)
-    return ESP_FAIL;
-  uint8_t message[1];
-  message[0] = type;
-  return esp_now_send(mac, message, sizeof(message));
+void refillTokens() {
+  unsigned long elapsed = Clock::millis() - _tx_tokens_updated_at;
+  _tx_tokens_updated_at += elapsed;
+  // Any longer and every bucket is full anyway.
+  elapsed = min(elapsed, 1000UL);
+  for (int i = 0; i < TRAFFIC_CLASSES; i++)
+    _tx_tokens[i] = min(_tx_tokens[i] + elapsed * FRAME_RATES[i], MAX_TOKENS);
+}
+
+// The lane to send from next: the most urgent one with a frame waiting and
+// budget left, CRITICAL frames never waiting for budget.
+FrameSlots *nextLane() {
+  for (int i = 0; i < TRAFFIC_CLASSES; i++)
+    if (_tx_lanes[i].size() > 0 && (i == CRITICAL || _tx_tokens[i] >= 1000))
+      return &_tx_lanes[i];
+  return nullptr;
+}
+
+// Hands queued frames to the transport, most urgent first, keeping at most
+// MAX_FRAMES_IN_FLIGHT in its buffers so that a late urgent frame does not
+// queue behind a long line of background ones. Whatever is left is retried
+// from updateProtocol().
+void sendTxFrames() {
+  refillTokens();
+  while (_tx_in_flight.size() < MAX_FRAMES_IN_FLIGHT) {
+    FrameSlots *lane = nextLane();
+    if (lane == nullptr)
+      return;
+    uint8_t slot = *lane->peek();
+    const PendingFrame &frame = _tx_frames[slot];
+    const uint8_t *mac = frame.addressed ? BROADCAST_ADDRESS : frame.mac;
+    esp_err_t result = _transport->send(mac, frame.data, frame.len);
+    if (result == ESP_ERR_NO_MEM)
+      return;
+    lane->pop();
+    int traffic_class = lane - _tx_lanes;
+    if (traffic_class != CRITICAL)
+      _tx_tokens[traffic_class] -= 1000;
+    if (result != ESP_OK) {
+      forEachMessage(
+          frame, [&](MessageType type) { Stats::sendFailed(type, frame.mac); });
+      *_tx_free.reserve() = slot;
+      _tx_free.push();
+      continue;
+    }
+    *_tx_in_flight.reserve() = slot;
+    _tx_in_flight.push();
+    completeSentFrames();
+  }
 }
 
-template <typename T>
-esp_err_t send(MessageType type, const T &info, const uint8_t *mac) {
+// Matches the transport's reports with the frames in flight, which it
+// completes in order.
+void completeSentFrames() {
+  while (bool *delivered = _tx_reports.peek()) {
+    uint8_t *slot = _tx_in_flight.peek();
+    if (slot != nullptr) {
+      const PendingFrame &frame = _tx_frames[*slot];
+      if (!*delivered)
+        forEachMessage(frame, [&](MessageType type) {
+          Stats::undelivered(type, frame.mac);
+        });
+      if (_frame_sent != nullptr) {
+        _sent_frame = &frame;
+        _frame_sent(frame.mac, *delivered);
+        _sent_frame = nullptr;
+      }
+      *_tx_free.reserve() = *slot;
+      _tx_free.push();
+      _tx_in_flight.pop();
+    }
+    _tx_reports.pop();
+  }
+}
+
+// The last CRITICAL_TX_SLOTS free slots only take CRITICAL frames, so rate
+// limited traffic piling up cannot lock them out.
+bool enqueueFrame(const PendingFrame &frame) {
+  TrafficClass traffic_class = BACKGROUND;
+  forEachMessage(frame, [&](MessageType type) {
+    traffic_class = min(traffic_class, trafficClass(type));
+  });
+  size_t reserved = traffic_class == CRITICAL ? 0 : CRITICAL_TX_SLOTS;
+  if (_tx_free.size() <= reserved)
+    completeSentFrames();
+  if (_tx_free.size() <= reserved)
+    return false;
+  uint8_t *slot = _tx_free.peek();
+  _tx_frames[*slot] = frame;
+  FrameSlots &lane = _tx_lanes[traffic_class];
+  *lane.reserve() = *slot;
+  lane.push();
+  _tx_free.pop();
+  return true;
+}
+
+void flushMessages() {
+  int flushed = 0;
+  while (flushed < _pending_frames_count &&
+         enqueueFrame(_pending_frames[flushed]))
+    flushed++;
+  _pending_frames_count -= flushed;
+  for (int i = 0; i < _pending_frames_count; i++)
+    _pending_frames[i] = _pending_frames[flushed + i];
+  sendTxFrames();
+}
+
+PendingFrame *pendingFrameFor(const uint8_t *mac, int len) {
+  for (int i = 0; i < _pending_frames_count; i++) {
+    PendingFrame &frame = _pending_frames[i];
+    if (memcmp(frame.mac, mac, 6) != 0)
+      continue;
+    if (frame.len + len > MAX_FRAME_SIZE) {
+      if (!enqueueFrame(frame))
+        return nullptr;
+      sendTxFrames();
+      frame.len = frame.header_len;
+    }
+    return &frame;
+  }
+  if (_pending_frames_count == MAX_PENDING_FRAMES)
+    flushMessages();
+  if (_pending_frames_count == MAX_PENDING_FRAMES)
+    return nullptr;
+  PendingFrame &frame = _pending_frames[_pending_frames_count++];
+  memcpy(frame.mac, mac, 6);
+  frame.addressed = _addressed_peers.find(mac) != PeerTable<MAX_PEERS>::NONE;
+  frame.data[0] = PROTOCOL_VERSION;
+  frame.data[1] = frame.addressed ? FRAME_ADDRESSED : 0;
+  frame.data[2] = _epoch & 0xff;
+  frame.data[3] = _epoch >> 8;
+  frame.header_len = FRAME_HEADER_SIZE;
+  if (frame.addressed) {
+    memcpy(frame.data + FRAME_HEADER_SIZE, mac, MAC_ADDRESS_SIZE);
+    frame.header_len += MAC_ADDRESS_SIZE;
+  }
+  frame.len = frame.header_len;
+  return &frame;
+}
+
+uint8_t *queueMessage(MessageType type, int len, const uint8_t *mac) {
   if (!_started)
-    return ESP_FAIL;
-  uint8_t message[sizeof(info) + 1];
-  message[0] = type;
-  memcpy(message + 1, &info, sizeof(info));
-  return esp_now_send(mac, message, sizeof(message));
+    return nullptr;
+  PendingFrame *frame = pendingFrameFor(mac, len + MESSAGE_HEADER_SIZE);
+  if (frame == nullptr)
+    return nullptr;
+  uint8_t *message = frame->data + frame->len;
+  message[0] = len + 1;
+  message[1] = type;
+  frame->len += len + MESSAGE_HEADER_SIZE;
+  Stats::sent(type, mac);
+  return message + MESSAGE_HEADER_SIZE;
+}
+
+bool tryConnectingToPeer(const uint8_t *mac, esp_now_peer_info_t *peer) {
+  memcpy(peer->peer_addr, mac, 6);
+  peer->channel = 0;
+  peer->encrypt = false;
+  if (_transport->addPeer(peer->peer_addr))
+    return true;
+  return _addressed_peers.add(mac) != PeerTable<MAX_PEERS>::NONE;
+}
+
+bool removePeer(const uint8_t *mac) {
+  if (_addressed_peers.remove(mac))
+    return true;
+  return _transport->removePeer(mac);
+}
+
+void Handlers::onHeartbeat(const uint8_t *mac) {
+  HeartbeatAck ack;
+  ack.type = _type;
+  send(ack, mac);
+}
+
+// Runs in the transport's receive task, which may not be the loop task, so it
+// only queues the frame for updateProtocol().
+void onDataRecv(const uint8_t *mac, const uint8_t *incoming_data, int len) {
+  if (len <= 0 || len > MAX_FRAME_SIZE)
+    return;
+  ReceivedFrame *frame = _received_frames.reserve();
+  if (frame == nullptr)
+    return;
+  frame->received_at = Clock::millis();
+  memcpy(frame->mac, mac, 6);
+  memcpy(frame->data, incoming_data, len);
+  frame->len = len;
+  _received_frames.push();
+}
+
+// Runs in the transport's send task; like onDataRecv it only queues the report.
+void onDataSent(const uint8_t *mac, bool delivered) {
+  bool *report = _tx_reports.reserve();
+  if (report == nullptr)
+    return;
+  *report = delivered;
+  _tx_reports.push();
 }
 
-esp_err_t send(Connection info, const uint8_t *mac) {
-  return send(CONNECTION, info, mac);
+void handleFrame(const uint8_t *mac, const uint8_t *incoming_data, int len) {
+  if (len < FRAME_HEADER_SIZE || incoming_data[0] != PROTOCOL_VERSION)
+    return;
+  int position = FRAME_HEADER_SIZE;
+  if (incoming_data[1] & FRAME_ADDRESSED) {
+    position += MAC_ADDRESS_SIZE;
+    if (len < position || memcmp(incoming_data + FRAME_HEADER_SIZE,
+                                 _mac_address, MAC_ADDRESS_SIZE) != 0)
+      return;
+  }
+  if (!_frame(mac, incoming_data[2] | (incoming_data[3] << 8)))
+    return;
+  while (position < len) {
+    int message_len = incoming_data[position];
+    position++;
+    if (message_len == 0 || position + message_len > len)
+      return;
+    handleMessage(mac, incoming_data + position, message_len);
+    position += message_len;
+  }
+}
+
+void handleMessage(const uint8_t *mac, const uint8_t *message, int len) {
+  uint8_t type = message[0];
+  if (type >= MESSAGE_TYPES)
+    return;
+  Stats::received((MessageType)type, mac);
+  if (_handlers[type] == nullptr)
+    return;
+  _handlers[type](mac, message + 1, len - 1);
+}
+
+BombInfo decode(BombInfoView view) {
+  BombInfo info;
+  info.request_key = view.get<BombInfoWire::RequestKey>();
+  info.sequence = view.get<BombInfoWire::Sequence>();
+  memcpy(info.time, view.get<BombInfoWire::Time>(), TIME_LENGTH);
+  info.time[TIME_LENGTH] = '\0';
+  info.strikes = view.get<BombInfoWire::Strikes>();
+  info.max_strikes = view.get<BombInfoWire::MaxStrikes>();
+  info.failed = view.get<BombInfoWire::Failed>();
+  info.solved = view.get<BombInfoWire::Solved>();
+  info.code = view.get<BombInfoWire::Code>();
+  info.total_puzzle_modules = view.get<BombInfoWire::TotalPuzzleModules>();
+  info.solved_puzzle_modules = view.get<BombInfoWire::SolvedPuzzleModules>();
+  info.total_needy_modules = view.get<BombInfoWire::TotalNeedyModules>();
+  info.timer_anchor = view.get<BombInfoWire::TimerAnchor>();
+  info.timer_elapsed = view.get<BombInfoWire::TimerElapsed>();
+  info.duration = view.get<BombInfoWire::Duration>();
+  info.speed = view.get<BombInfoWire::Speed>();
+  info.running = view.get<BombInfoWire::Running>();
+  info.ack_slots = view.get<BombInfoWire::AckSlots>();
+  return info;
 }
 
-esp_err_t send(BombInfoRequest info, const uint8_t *mac) {
-  return send(BOMB_INFO_REQUEST, info, mac);
+void encode(const Connection &info, uint8_t *payload) {
+  Wire::Writer<ConnectionWire> writer(payload);
+  writer.set<ConnectionWire::MacAddress>(info.mac_address);
+  writer.set<ConnectionWire::AckSlots>(info.ack_slots);
 }
 
-esp_err_t send(BombInfo info, const uint8_t *mac) {
-  return send(BOMB_INFO, info, mac);
+void encode(const BombInfo &info, uint8_t *payload) {
+  Wire::Writer<BombInfoWire> writer(payload);
+  writer.set<BombInfoWire::RequestKey>(info.request_key);
+  writer.set<BombInfoWire::Sequence>(info.sequence);
+  writer.set<BombInfoWire::Time>(info.time);
+  writer.set<BombInfoWire::Strikes>(info.strikes);
+  writer.set<BombInfoWire::MaxStrikes>(info.max_strikes);
+  writer.set<BombInfoWire::Failed>(info.failed);
+  writer.set<BombInfoWire::Solved>(info.solved);
+  writer.set<BombInfoWire::Code>(info.code);
+  writer.set<BombInfoWire::TotalPuzzleModules>(info.total_puzzle_modules);
+  writer.set<BombInfoWire::SolvedPuzzleModules>(info.solved_puzzle_modules);
+  writer.set<BombInfoWire::TotalNeedyModules>(info.total_needy_modules);
+  writer.set<BombInfoWire::TimerAnchor>(info.timer_anchor);
+  writer.set<BombInfoWire::TimerElapsed>(info.timer_elapsed);
+  writer.set<BombInfoWire::Duration>(info.duration);
+  writer.set<BombInfoWire::Speed>(info.speed);
+  writer.set<BombInfoWire::Running>(info.running);
+  writer.set<BombInfoWire::AckSlots>(info.ack_slots);
 }
 
-esp_err_t send(SolveAttempt info, const uint8_t *mac) {
-  return send(SOLVE_ATTEMPT, info, mac);
+void encode(const BombInfoRequest &info, uint8_t *payload) {
+  Wire::Writer<BombInfoRequestWire> writer(payload);
+  writer.set<BombInfoRequestWire::Key>(info.key);
 }
 
-esp_err_t send(SolveAttemptAck info, const uint8_t *mac) {
-  return send(SOLVE_ATTEMPT_ACK, info, mac);
+void encode(const SolveAttempt &info, uint8_t *payload) {
+  Wire::Writer<SolveAttemptWire> writer(payload);
+  writer.set<SolveAttemptWire::Key>(info.key);
+  writer.set<SolveAttemptWire::Strike>(info.strike);
+  writer.set<SolveAttemptWire::Fail>(info.fail);
 }
 
-esp_err_t send(MessageType type, ModuleType module_type, const uint8_t *mac) {
-  return send<ModuleType>(type, module_type, mac);
-}
\ No newline at end of file
+void encode(const SolveAttemptAck &info, uint8_t *payload) {
+  Wire::Writer<SolveAttemptAckWire> writer(payload);
+  writer.set<SolveAttemptAckWire::Key>(info.key);
+  writer.set<SolveAttemptAckWire::Strike>(info.strike);
+}
+
+void encode(const HeartbeatAck &info, uint8_t *payload) {
+  Wire::Writer<HeartbeatAckWire> writer(payload);
+  writer.set<HeartbeatAckWire::Type>((uint8_t)info.type);
+}
+
+void encode(const Announce &info, uint8_t *payload) {
+  Wire::Writer<AnnounceWire> writer(payload);
+  writer.set<AnnounceWire::Type>((uint8_t)info.type);
+  writer.set<AnnounceWire::Connected>(info.connected);
+  writer.set<AnnounceWire::Boot>(info.boot);
+}
+
+void encode(const TimeSyncRequest &info, uint8_t *payload) {
+  Wire::Writer<TimeSyncRequestWire> writer(payload);
+  writer.set<TimeSyncRequestWire::Origin>(info.origin);
+}
+
+void encode(const TimeSync &info, uint8_t *payload) {
+  Wire::Writer<TimeSyncWire> writer(payload);
+  writer.set<TimeSyncWire::Origin>(info.origin);
+  writer.set<TimeSyncWire::Receive>(info.receive);
+  writer.set<TimeSyncWire::Transmit>(info.transmit);
+}
+
+esp_err_t send(MessageType type, const uint8_t *mac) {
+  return queueMessage(type, 0, mac) == nullptr ? ESP_FAIL : ESP_OK;
+}
+
+void formatTime(char *buffer, unsigned long remaining, bool show_millis) {
+  int minutes = remaining / 60000;
+  int seconds = (remaining % 60000) / 1000;
+  int hundredths = (remaining % 1000) / 10;
+  if (minutes == 0 && show_millis)
+    snprintf(buffer, TIME_LENGTH + 1, "%02d.%02d", seconds, hundredths);
+  else
+    snprintf(buffer, TIME_LENGTH + 1, "%02d:%02d", minutes, seconds);
+}
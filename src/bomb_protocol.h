@@ -3,8 +3,13 @@
 
 #include <Arduino.h>
 #include <WiFi.h>
+#include <clock.h>
 #include <esp_now.h>
-#include <functional>
+#include <messages.h>
+#include <node_local.h>
+#include <transport/transport.h>
+#include <utils/callback.h>
+#include <utils/timer_wheel.h>
 
 #ifndef APP_VERSION
 #define APP_VERSION "Unknown"
@@ -18,99 +23,246 @@
 #define BAUD_RATE 9600
 #endif
 
-const int MAC_ADDRESS_SIZE = 18;
+// Destinations with messages waiting for the next flushMessages().
+#ifndef MAX_PENDING_FRAMES
+#define MAX_PENDING_FRAMES 4
+#endif
+
+// Peers the protocol can address, counting those reached through addressed
+// broadcast frames once the transport runs out of unicast peers.
+#ifndef MAX_PEERS
+#define MAX_PEERS 64
+#endif
+
+// Frames waiting for the transport, sent or not yet, must be a power of 2.
+// Once full, send() fails until the transport reports earlier frames done.
+#ifndef TX_QUEUE_SIZE
+#define TX_QUEUE_SIZE 16
+#endif
 
-enum ModuleType {
-  Main,
-  Puzzle,
-  Needy,
-  Spectator,
+// Frames handed to the transport and not reported sent yet. Kept low so that
+// urgent frames do not wait behind others in the transport's own buffers.
+#ifndef MAX_FRAMES_IN_FLIGHT
+#define MAX_FRAMES_IN_FLIGHT 4
+#endif
+
+// Frames per second the CONTROL and BACKGROUND traffic classes may send on
+// average, and how many frames any class may send in a burst.
+#ifndef CONTROL_FRAME_RATE
+#define CONTROL_FRAME_RATE 200
+#endif
+#ifndef BACKGROUND_FRAME_RATE
+#define BACKGROUND_FRAME_RATE 100
+#endif
+#ifndef FRAME_BURST
+#define FRAME_BURST 8
+#endif
+
+// Frames received between two updateProtocol() calls, must be a power of 2.
+#ifndef RECEIVE_QUEUE_SIZE
+#define RECEIVE_QUEUE_SIZE 32
+#endif
+
+// Solve attempts a module keeps in flight before waiting for acks, and how
+// many more can wait behind them, the latter a power of 2.
+#ifndef SOLVE_ATTEMPT_WINDOW
+#define SOLVE_ATTEMPT_WINDOW 8
+#endif
+#ifndef SOLVE_ATTEMPT_QUEUE_SIZE
+#define SOLVE_ATTEMPT_QUEUE_SIZE 16
+#endif
+
+// Callers of Module::withBombInfo that can wait for an answer at once.
+#ifndef BOMB_INFO_WAITERS
+#define BOMB_INFO_WAITERS 8
+#endif
+
+// Bytes a callback given to the protocol may capture, see Callback.
+#ifndef CALLBACK_SIZE
+#define CALLBACK_SIZE 16
+#endif
+
+// Once the game started, the main module sends HEARTBEAT every
+// LIVENESS_HEARTBEAT_DELAY ms and suspects a module to have failed when the
+// phi of its failure detector reaches PHI_THRESHOLD, see PhiDetector. Higher
+// thresholds and PHI_MIN_STDDEV detect failures later and suspect modules that
+// are only slow less often.
+#ifndef LIVENESS_HEARTBEAT_DELAY
+#define LIVENESS_HEARTBEAT_DELAY 1000
+#endif
+#ifndef PHI_THRESHOLD
+#define PHI_THRESHOLD 8
+#endif
+#ifndef PHI_MIN_STDDEV
+#define PHI_MIN_STDDEV 500
+#endif
+
+// Broadcasts every module answers, HEARTBEAT, START and RESET, are answered
+// within a window of ACK_SLOT ms per module, each module in the slot its MAC
+// hashes to and at a random point of it, so the answers do not all go out at
+// once and collide. A slot holds one ack frame: about 0.9 ms of airtime at
+// 1 Mbps with its MAC-layer ack, plus the contention before it. The main
+// module lays out one slot per module it knows and sends the count in
+// CONNECTION and BOMB_INFO; modules use ACK_DEFAULT_SLOTS until they heard it.
+#ifndef ACK_SLOT
+#define ACK_SLOT 2
+#endif
+#ifndef ACK_DEFAULT_SLOTS
+#define ACK_DEFAULT_SLOTS 32
+#endif
+
+using BombInfoCallback = Callback<void(BombInfo info), CALLBACK_SIZE>;
+
+// Outgoing frames are sent most urgent class first. A frame takes the class of
+// its most urgent message: solve attempts and resets are CRITICAL and never
+// held back, start and bomb info traffic is CONTROL, beacons, heartbeats and
+// clock sync are BACKGROUND. The last two are limited to their frame rates.
+enum TrafficClass { CRITICAL, CONTROL, BACKGROUND, TRAFFIC_CLASSES };
+TrafficClass trafficClass(MessageType type);
+
+// Default handler set: every message a module does not care about is dropped,
+// except HEARTBEAT which is always answered. Modules derive from it and hide
+// the handlers they need with static members of the same name.
+struct Handlers {
+  static void onConnection(ConnectionView info, const uint8_t *mac) {}
+  static void onBombInfo(const BombInfo &info, const uint8_t *mac) {}
+  static void onBombInfoRequest(BombInfoRequestView info, const uint8_t *mac) {}
+  static void onSolveAttempt(SolveAttemptView info, const uint8_t *mac) {}
+  static void onSolveAttemptAck(SolveAttemptAckView info) {}
+  static void onStart() {}
+  static void onStartAck(const uint8_t *mac) {}
+  static void onReset() {}
+  static void onResetAck(const uint8_t *mac) {}
+  static void onHeartbeat(const uint8_t *mac);
+  static void onHeartbeatAck(HeartbeatAckView info, const uint8_t *mac) {}
+  static void onTimeSyncRequest(TimeSyncRequestView info, const uint8_t *mac) {}
+  static void onTimeSync(TimeSyncView info, const uint8_t *mac) {}
+  static void onAnnounce(AnnounceView info, const uint8_t *mac) {}
+  // Called before the messages of every frame from `mac`, which are dropped
+  // unless it returns true.
+  static bool onFrame(const uint8_t *mac, uint16_t epoch) { return true; }
+  // Whether a frame sent to `mac` got there, see TransportSent.
+  static void onFrameSent(const uint8_t *mac, bool delivered) {}
 };
 
-typedef struct BombInfo {
-  uint32_t request_key;
-  char time[6];
-  uint8_t strikes, max_strikes;
-  bool failed, solved;
-  uint16_t code;
-  uint8_t total_puzzle_modules, solved_puzzle_modules;
-  uint8_t total_needy_modules;
-} BombInfo;
-
-typedef struct BombInfoRequest {
-  int key;
-} BombInfoRequest;
-
-typedef struct Connection {
-  char mac_address[MAC_ADDRESS_SIZE];
-} Connection;
-
-typedef struct SolveAttempt {
-  bool strike;
-  int key;
-  bool fail;
-} SolveAttempt;
-
-typedef struct SolveAttemptAck {
-  bool strike;
-  int key;
-} SolveAttemptAck;
-
-enum MessageType {
-  UNKNOWN,
-  CONNECTION,
-  BOMB_INFO,
-  BOMB_INFO_REQUEST,
-  SOLVE_ATTEMPT,
-  SOLVE_ATTEMPT_ACK,
-  START,
-  START_ACK,
-  RESET,
-  RESET_ACK,
-  HEARTBEAT,
-  HEARTBEAT_ACK,
+using MessageHandler = void (*)(const uint8_t *mac, const uint8_t *payload,
+                                int len);
+using FrameHandler = bool (*)(const uint8_t *mac, uint16_t epoch);
+using FrameSentHandler = void (*)(const uint8_t *mac, bool delivered);
+
+// Dispatch table of a handler set, indexed by message type.
+template <typename H> struct Dispatcher {
+  template <MessageType TYPE>
+  static void handle(const uint8_t *mac, const uint8_t *payload, int len) {
+    using Schema = typename Message<TYPE>::Schema;
+    static_assert(Schema::SIZE <= MAX_PAYLOAD_SIZE,
+                  "message does not fit in a frame");
+    Wire::View<Schema> info(payload, len);
+    if (!info.valid())
+      return;
+    Message<TYPE>::template handle<H>(info, mac);
+  }
+
+  static constexpr MessageHandler TABLE[MESSAGE_TYPES] = {
+      nullptr,
+      handle<CONNECTION>,
+      handle<BOMB_INFO>,
+      handle<BOMB_INFO_REQUEST>,
+      handle<SOLVE_ATTEMPT>,
+      handle<SOLVE_ATTEMPT_ACK>,
+      handle<START>,
+      handle<START_ACK>,
+      handle<RESET>,
+      handle<RESET_ACK>,
+      handle<HEARTBEAT>,
+      handle<HEARTBEAT_ACK>,
+      handle<TIME_SYNC_REQUEST>,
+      handle<TIME_SYNC>,
+      handle<ANNOUNCE>,
+  };
 };
 
-using ConnectionCallback =
-    std::function<void(Connection info, const uint8_t *mac)>;
-using BombInfoCallback = std::function<void(BombInfo info)>;
-using BombInfoRequestCallback =
-    std::function<void(BombInfoRequest info, const uint8_t *mac)>;
-using SolveAttemptCallback =
-    std::function<void(SolveAttempt info, const uint8_t *mac)>;
-using SolveAttemptAckCallback = std::function<void(SolveAttemptAck info)>;
-using StartCallback = std::function<void()>;
-using StartAckCallback = std::function<void(const uint8_t *mac)>;
-using ResetCallback = std::function<void()>;
-using ResetAckCallback = std::function<void(const uint8_t *mac)>;
-using HeartbeatAckCallback =
-    std::function<void(ModuleType type, const uint8_t *mac)>;
-
-using Send = std::function<esp_err_t()>;
-
-typedef struct Callbacks {
-  ConnectionCallback connectionCallback;
-  BombInfoCallback bombInfoCallback;
-  BombInfoRequestCallback bombInfoRequestCallback;
-  SolveAttemptCallback solveAttemptCallback;
-  SolveAttemptAckCallback solveAttemptAckCallback;
-  StartCallback startCallback;
-  StartAckCallback startAckCallback;
-  ResetCallback resetCallback;
-  ResetAckCallback resetAckCallback;
-  HeartbeatAckCallback heartbeatAckCallback;
-} Callbacks;
-
-bool initProtocol(String, Callbacks, ModuleType);
+template <typename H>
+constexpr MessageHandler Dispatcher<H>::TABLE[MESSAGE_TYPES];
 
+// Selects how frames reach the other modules, ESP-NOW by default. Must be
+// called before initProtocol; the transport has to outlive the protocol.
+void setTransport(Transport *transport);
+bool initProtocol(const char *name, const MessageHandler *handlers,
+                  FrameHandler frame, FrameSentHandler frame_sent, ModuleType);
+template <typename H> bool initProtocol(const char *name, ModuleType type) {
+  return initProtocol(name, Dispatcher<H>::TABLE, H::onFrame, H::onFrameSent,
+                      type);
+}
+// Runs the callbacks of the frames received and sent since the last call and
+// of the timers that are due, and retries frames the transport had no room
+// for. Module and MainModule call it from their update().
+void updateProtocol();
+// Clock::millis() when the frame being handled arrived, for handlers that
+// timestamp.
+unsigned long frameReceivedAt();
+// Whether the frame a FrameSentHandler is reporting on carried a message of
+// `type`.
+bool sentFrameCarries(MessageType type);
+// Epoch stamped on the frames sent from now on. Messages still queued under the
+// previous one are dropped, as their receivers would drop them anyway.
+void setEpoch(uint16_t epoch);
+uint16_t epoch();
+// Whether `frame_epoch` is one of the STALE_EPOCHS epochs just before the
+// current one. Frames of those are left over from earlier games and reordered,
+// anything further off comes from a node that restarted.
+const int16_t STALE_EPOCHS = 16;
+bool staleEpoch(uint16_t frame_epoch);
+// Runs `timer` from updateProtocol() `delay` ms from now, then every `period`
+// ms unless 0. Starting a running timer moves it.
+void startTimer(Timer &timer, unsigned long delay, unsigned long period = 0);
+void stopTimer(Timer &timer);
+// `delay` moved randomly by up to a quarter either way, so that nodes powered
+// on together do not keep transmitting at the same moments.
+unsigned long jitter(unsigned long delay);
+// How many ack slots the main module lays out for `modules` known modules.
+int ackSlots(int modules);
+// How long the answers to a broadcast take at most over `slots` ack slots.
+unsigned long ackWindow(int slots);
+// When the slot of the node `mac` starts, counting from the broadcast, see
+// ACK_SLOT.
+unsigned long ackSlotStart(const uint8_t *mac, int slots);
+// How long after a broadcast this node sends its answer.
+unsigned long ackDelay(int slots);
+// How many ms the loop can sleep before updateProtocol() has work to do, at
+// most `max_idle`.
+unsigned long idleTime(unsigned long max_idle = 1000);
+// Sends the messages queued by send() since the last call, packing all the
+// messages for a destination into as few frames as possible. Module and
+// MainModule call it at the end of their update().
+void flushMessages();
+
+// Registers `mac` with the transport. When the transport has no room left,
+// the peer is reached through addressed broadcast frames instead.
 bool tryConnectingToPeer(const uint8_t *mac, esp_now_peer_info_t *peer);
+bool removePeer(const uint8_t *mac);
+
+// Appends a message to the frame for `mac` and returns where its payload of
+// `len` bytes goes, or nullptr when the protocol is not running or the TX
+// queue is full.
+uint8_t *queueMessage(MessageType type, int len, const uint8_t *mac);
 
 esp_err_t send(MessageType type, const uint8_t *mac);
-esp_err_t send(Connection info, const uint8_t *mac);
-esp_err_t send(BombInfo info, const uint8_t *mac);
-esp_err_t send(BombInfoRequest info, const uint8_t *mac);
-esp_err_t send(SolveAttempt info, const uint8_t *mac);
-esp_err_t send(SolveAttemptAck info, const uint8_t *mac);
-esp_err_t send(MessageType type, ModuleType module_type, const uint8_t *mac);
-
-#endif
\ No newline at end of file
+
+// Formats `remaining` ms as BombInfo::time does, into a buffer of at least
+// TIME_LENGTH + 1 chars: hundredths of a second in the last minute when
+// `show_millis` is set, minutes and seconds otherwise.
+void formatTime(char *buffer, unsigned long remaining, bool show_millis = true);
+
+template <typename T> esp_err_t send(const T &info, const uint8_t *mac) {
+  using Schema = typename Message<MessageFor<T>::TYPE>::Schema;
+  static_assert(Schema::SIZE <= MAX_PAYLOAD_SIZE,
+                "message does not fit in a frame");
+  uint8_t *payload = queueMessage(MessageFor<T>::TYPE, Schema::SIZE, mac);
+  if (payload == nullptr)
+    return ESP_FAIL;
+  encode(info, payload);
+  return ESP_OK;
+}
+
+#endif
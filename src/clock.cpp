@@ -0,0 +1,15 @@
+#include <Arduino.h>
+#include <clock.h>
+
+namespace Clock {
+NODE_LOCAL System _system;
+NODE_LOCAL Source *_source = &_system;
+
+unsigned long System::millis() { return ::millis(); }
+
+void setSource(Source *source) {
+  _source = source != nullptr ? source : &_system;
+}
+
+unsigned long millis() { return _source->millis(); }
+} // namespace Clock
@@ -0,0 +1,39 @@
+#ifndef CLOCK_H
+#define CLOCK_H
+
+#include <node_local.h>
+
+// Time as seen by the protocol and the modules. Everything that schedules or
+// timestamps goes through Clock::millis() so host builds can drive it from a
+// simulation instead of the board's timer.
+namespace Clock {
+class Source {
+public:
+  virtual ~Source() {}
+  virtual unsigned long millis() = 0;
+};
+
+// The board's millis(), used unless another source is set.
+class System : public Source {
+public:
+  unsigned long millis() override;
+};
+
+// Only moves when told to, so a run can skip ahead or replay exactly.
+class Virtual : public Source {
+public:
+  Virtual(unsigned long now = 0) : _now(now) {}
+  unsigned long millis() override { return _now; }
+  void set(unsigned long now) { _now = now; }
+  void advance(unsigned long ms) { _now += ms; }
+
+private:
+  unsigned long _now;
+};
+
+// Uses `source` for this node until changed, nullptr restores System.
+void setSource(Source *source);
+unsigned long millis();
+} // namespace Clock
+
+#endif // CLOCK_H
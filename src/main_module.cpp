@@ -1,8 +1,11 @@
+#include <Preferences.h>
 #include <main_module.h>
-#include <map>
 #include <ota.h>
-#include <set>
-#include <utils/debouncer.h>
+#include <peer_table.h>
+#include <stats.h>
+#include <utils/bitset.h>
+#include <utils/phi_detector.h>
+#include <utils/replay_window.h>
 
 namespace MainModule {
 const int MAX_CODE = 9999;
@@ -10,61 +13,148 @@ const int MAX_CODE = 9999;
 const unsigned long ONE_SECOND = 1000;
 const unsigned long ONE_MINUTE = 60 * ONE_SECOND;
 
-String mac_address;
-esp_now_peer_info_t broadcast;
-esp_now_peer_info_t modules[MAX_MODULES];
-bool modules_solved[MAX_MODULES];
-bool modules_started[MAX_MODULES];
-bool modules_reset[MAX_MODULES];
-ModuleType modules_types[MAX_MODULES];
-int modules_connected = 0;
-
-OnSolved onSolved = nullptr;
-OnFailed onFailed = nullptr;
-OnStrike onStrike = nullptr;
-
-bool _should_reset;
-unsigned long _should_start_at = 0;
-
-bool _started;
-bool _solved;
-bool _failed;
-
-int _strikes;
-int _max_strikes;
-
-int _code;
-
-unsigned long _duration;
-unsigned long _start_time;
-unsigned long _elapsed_time[SPEED_STAGES];
-unsigned long _last_update_time;
-
-const int BROADCAST_DEBOUNCE_DELAY = 1000;
-Debouncer broadcast_debouncer(BROADCAST_DEBOUNCE_DELAY);
-const int START_DEBOUNCE_QUICK_DELAY = 50;
-const int START_DEBOUNCE_SLOW_DELAY = 500;
-Debouncer start_debouncer_quick(START_DEBOUNCE_QUICK_DELAY);
-Debouncer start_debouncer_slow(START_DEBOUNCE_SLOW_DELAY);
-const int RESET_DEBOUNCE_DELAY = 100;
-Debouncer reset_debouncer(RESET_DEBOUNCE_DELAY);
-const int HEARTBEAT_DEBOUNCE_DELAY = 100;
-Debouncer heartbeat_debouncer(HEARTBEAT_DEBOUNCE_DELAY);
-
-std::map<int, std::set<int>> _pending_solve_attempts;
-
-bool compareMacAddress(const uint8_t *mac1, const uint8_t *mac2) {
-  for (int i = 0; i < 6; i++)
-    if (mac1[i] != mac2[i])
-      return false;
-  return true;
-}
-
-int findMacAddress(const uint8_t *mac) {
-  for (int i = 0; i < modules_connected; i++)
-    if (compareMacAddress(mac, modules[i].peer_addr))
-      return i;
-  return -1;
+NODE_LOCAL uint8_t mac_address[MAC_ADDRESS_SIZE];
+NODE_LOCAL esp_now_peer_info_t broadcast;
+NODE_LOCAL PeerTable<MAX_MODULES> modules;
+NODE_LOCAL Bitset<MAX_MODULES> modules_solved;
+NODE_LOCAL Bitset<MAX_MODULES> modules_started;
+NODE_LOCAL Bitset<MAX_MODULES> modules_reset;
+NODE_LOCAL Bitset<MAX_MODULES> puzzle_modules;
+NODE_LOCAL ModuleType modules_types[MAX_MODULES];
+NODE_LOCAL ReplayWindow modules_solve_attempts[MAX_MODULES];
+// Boot of each module, from its last ANNOUNCE. A module that restarted counts
+// its solve attempts from scratch.
+NODE_LOCAL uint32_t modules_boots[MAX_MODULES];
+NODE_LOCAL uint8_t total_puzzle_modules;
+NODE_LOCAL uint8_t solved_puzzle_modules;
+NODE_LOCAL uint8_t total_needy_modules;
+
+NODE_LOCAL OnSolved onSolved = nullptr;
+NODE_LOCAL OnFailed onFailed = nullptr;
+NODE_LOCAL OnStrike onStrike = nullptr;
+NODE_LOCAL OnSuspected onSuspected = nullptr;
+
+NODE_LOCAL unsigned long _should_start_at = 0;
+
+NODE_LOCAL bool _started;
+NODE_LOCAL bool _solved;
+NODE_LOCAL bool _failed;
+
+NODE_LOCAL int _strikes;
+NODE_LOCAL int _max_strikes;
+
+NODE_LOCAL int _code;
+
+NODE_LOCAL unsigned long _duration;
+NODE_LOCAL unsigned long _start_time;
+NODE_LOCAL unsigned long _elapsed_time[SPEED_STAGES];
+NODE_LOCAL unsigned long _last_update_time;
+
+void broadcastMacAddress();
+void broadcastStart();
+void retransmitStart();
+void sendHeartbeat();
+void broadcastReset();
+void retransmitReset();
+void publishBombInfo();
+void checkLiveness();
+
+// Periodic broadcasts, started and stopped as the game moves along instead of
+// being polled every update(). HEARTBEAT runs during the countdown, and more
+// slowly during the game.
+const unsigned long HEARTBEAT_DELAY = 100;
+NODE_LOCAL Timer heartbeat_timer(sendHeartbeat);
+
+// CONNECTION beacons go out every BEACON_MIN_DELAY at first and twice as
+// slowly after each one, up to BEACON_MAX_DELAY, until a module joins and
+// they start over. Modules announce themselves as well, so slow beacons only
+// matter to those that missed both.
+const unsigned long BEACON_MIN_DELAY = 50;
+const unsigned long BEACON_MAX_DELAY = 4000;
+NODE_LOCAL Timer beacon_timer(broadcastMacAddress);
+NODE_LOCAL unsigned long _beacon_delay;
+
+// START and RESET are barriers: broadcast once, then sent only to the known
+// modules that have not acked, as one broadcast again while more than
+// BARRIER_UNICAST_MAX of them are left. Retries wait for the ack slots of the
+// modules they went to on top of their own delay, so that acks still to come
+// are not taken for lost. A first broadcast the TX queue had no room for is
+// tried again after SEND_RETRY_DELAY.
+const int BARRIER_UNICAST_MAX = 4;
+const unsigned long SEND_RETRY_DELAY = 5;
+
+// START goes out when the countdown ends and is retried every
+// START_RETRY_DELAY. The game begins once every module acked, or after
+// START_BARRIER_TIMEOUT at the latest. Modules that missed it catch up from the
+// next BOMB_INFO, which says the bomb is running.
+const unsigned long START_RETRY_DELAY = 10;
+const unsigned long START_BARRIER_TIMEOUT = 1000;
+NODE_LOCAL Timer start_timer(broadcastStart);
+NODE_LOCAL Timer start_retry_timer(retransmitStart);
+NODE_LOCAL bool _start_retransmitted;
+
+// RESET moves every module to the next epoch while the peer table stays as it
+// is, and is retried every RESET_RETRY_DELAY until every module acked or
+// RESET_BARRIER_TIMEOUT passed. Modules that still have not acked by then are
+// taken for gone and evicted, so the next game does not wait for them. One
+// that was only out of reach follows the new epoch from the next frame of the
+// main module it gets and joins again with its next HEARTBEAT_ACK.
+const unsigned long RESET_RETRY_DELAY = 30;
+const unsigned long RESET_BARRIER_TIMEOUT = 2000;
+NODE_LOCAL Timer reset_timer(broadcastReset);
+NODE_LOCAL Timer reset_retry_timer(retransmitReset);
+NODE_LOCAL unsigned long _reset_sent_at;
+NODE_LOCAL bool _reset_retransmitted;
+
+// The epoch is kept in flash, so that a main module that restarts moves past
+// every epoch its modules may still be on. A random one could land among the
+// STALE_EPOCHS just behind theirs, and they would drop all of its frames.
+const char *EPOCH_NAMESPACE = "main_module";
+const char *EPOCH_KEY = "epoch";
+NODE_LOCAL Preferences epoch_storage;
+
+// When the last START broadcast and HEARTBEAT went out, to time their acks.
+// HEARTBEAT_RTT only takes the first ack of each heartbeat, as the next
+// heartbeat may go out before the slowest slots answered the previous one.
+NODE_LOCAL unsigned long _start_sent_at;
+NODE_LOCAL unsigned long _heartbeat_sent_at;
+NODE_LOCAL bool _heartbeat_timed;
+
+// BOMB_INFO payload answered to every request, re-encoded only after the
+// bomb state or the displayed time changes.
+NODE_LOCAL uint8_t _bomb_info_payload[BombInfoWire::SIZE];
+NODE_LOCAL bool _bomb_info_dirty;
+NODE_LOCAL unsigned long _bomb_info_displayed_time;
+
+// BOMB_INFO is also pushed to every module as soon as the bomb state changes,
+// and repeated as a keepalive otherwise. The sequence number moves exactly
+// when the state does; modules follow the countdown on their own from the
+// timer fields.
+const unsigned long BOMB_INFO_KEEPALIVE_DELAY = 1000;
+NODE_LOCAL uint16_t _bomb_info_sequence;
+NODE_LOCAL bool _bomb_info_changed;
+NODE_LOCAL Timer bomb_info_keepalive_timer(publishBombInfo);
+
+// HEARTBEAT keeps going during the game, slower, to tell whether the modules
+// are still there. Their answers feed a failure detector per module, checked
+// by liveness_timer when the first of them would become suspected. Every
+// heartbeat sent also records which of the modules known when the previous
+// one went out answered it, for their loss rates.
+const int HEARTBEAT_HISTORY = 32;
+NODE_LOCAL bool _liveness;
+NODE_LOCAL PhiDetector modules_liveness[MAX_MODULES];
+NODE_LOCAL Bitset<MAX_MODULES> modules_suspected;
+NODE_LOCAL Bitset<MAX_MODULES> modules_answered;
+NODE_LOCAL uint32_t modules_heartbeats[MAX_MODULES];
+NODE_LOCAL uint8_t modules_heartbeats_count[MAX_MODULES];
+NODE_LOCAL unsigned long modules_last_seen[MAX_MODULES];
+NODE_LOCAL int _heartbeat_modules;
+NODE_LOCAL Timer liveness_timer(checkLiveness);
+
+void bombInfoChanged() {
+  _bomb_info_sequence++;
+  _bomb_info_dirty = true;
+  _bomb_info_changed = true;
 }
 
 unsigned long elapsedTime() {
@@ -78,7 +168,8 @@ unsigned long elapsedTime() {
 bool started() { return _started; }
 
 bool starting() {
-  return !started() && _should_start_at != 0 && millis() > _should_start_at;
+  return !started() && _should_start_at != 0 &&
+         Clock::millis() > _should_start_at;
 }
 
 bool onStartCountdown() {
@@ -97,6 +188,7 @@ void solve() {
   if (onSolved != nullptr)
     onSolved();
   _solved = true;
+  bombInfoChanged();
 }
 
 bool failed() { return _failed; }
@@ -107,174 +199,398 @@ void fail() {
   if (onFailed != nullptr)
     onFailed();
   _failed = true;
+  bombInfoChanged();
 }
 
 void updateMissingTime() {
   if (!started() || solved() || failed())
     return;
-  unsigned long current_time = millis();
+  unsigned long current_time = Clock::millis();
   _elapsed_time[speed()] += current_time - _last_update_time;
   _last_update_time = current_time;
   if (elapsedTime() >= _duration)
     fail();
 }
 
-char *remainingTimeString(unsigned long elapsed, unsigned long duration,
-                          bool show_millis = true) {
-  unsigned long remaining = duration - elapsed;
-  int minutes = remaining / ONE_MINUTE;
-  int seconds = (remaining % ONE_MINUTE) / ONE_SECOND;
-  int milliseconds = (remaining % ONE_SECOND) / 10;
-  char *result = new char[6];
-  if (minutes == 0 && show_millis)
-    sprintf(result, "%02d.%02d", seconds, milliseconds);
-  else
-    sprintf(result, "%02d:%02d", minutes, seconds);
-  return result;
+void timeStrToStart(char *buffer) {
+  formatTime(buffer, max(Clock::millis(), _should_start_at) - Clock::millis());
 }
 
-char *timeStrToStart() {
-  return remainingTimeString(millis(), max(millis(), _should_start_at), true);
+void timeStr(char *buffer, bool show_millis) {
+  formatTime(buffer, _duration - elapsedTime(), show_millis);
 }
 
-char *timeStr(bool show_millis = true) {
-  return remainingTimeString(elapsedTime(), _duration, show_millis);
+// Changes exactly when the text of timeStr() does: every hundredth of a second
+// in the last minute, every second before that.
+unsigned long displayedTime() {
+  unsigned long remaining = _duration - elapsedTime();
+  if (remaining < ONE_MINUTE)
+    return remaining / 10;
+  return ONE_MINUTE + remaining / ONE_SECOND;
 }
 
 int code() { return _code; }
 
+int moduleCount() { return modules.size(); }
+
+bool validModule(int index) { return index >= 0 && index < modules.size(); }
+
+const uint8_t *moduleMac(int index) {
+  return validModule(index) ? modules.mac(index) : nullptr;
+}
+
+ModuleHealth moduleHealth(int index) {
+  ModuleHealth health = {};
+  if (!validModule(index))
+    return health;
+  health.last_seen = modules_last_seen[index];
+  health.suspicion =
+      _liveness ? modules_liveness[index].phi(Clock::millis(), PHI_MIN_STDDEV)
+                : 0;
+  int count = modules_heartbeats_count[index];
+  uint32_t answered = modules_heartbeats[index];
+  if (count < HEARTBEAT_HISTORY)
+    answered &= (1u << count) - 1;
+  health.loss_rate =
+      count == 0 ? 0 : 1 - (float)__builtin_popcount(answered) / count;
+  health.suspected = modules_suspected.test(index);
+  return health;
+}
+
+// Sent in CONNECTION and BOMB_INFO, so that the modules answer in the slots
+// this side expects.
+int ackSlotsInUse() { return ackSlots(modules.size()); }
+
 BombInfo bombInfo() {
   BombInfo info;
-  char *str = timeStr();
-  strcpy(info.time, str);
-  delete[] str;
+  info.request_key = 0;
+  info.sequence = _bomb_info_sequence;
+  timeStr(info.time);
   info.strikes = _strikes;
   info.max_strikes = _max_strikes;
   info.code = _code;
   info.failed = failed();
   info.solved = solved();
-  info.total_puzzle_modules = 0;
-  info.solved_puzzle_modules = 0;
-  info.total_needy_modules = 0;
-  for (int i = 0; i < modules_connected; i++) {
-    if (modules_types[i] == Puzzle) {
-      info.total_puzzle_modules++;
-      if (modules_solved[i])
-        info.solved_puzzle_modules++;
-    }
-    if (modules_types[i] == Needy)
-      info.total_needy_modules++;
-  }
+  info.total_puzzle_modules = total_puzzle_modules;
+  info.solved_puzzle_modules = solved_puzzle_modules;
+  info.total_needy_modules = total_needy_modules;
+  info.timer_anchor = _last_update_time;
+  info.timer_elapsed = elapsedTime();
+  info.duration = _duration;
+  info.speed = speed();
+  info.running = started() && !solved() && !failed();
+  info.ack_slots = ackSlotsInUse();
   return info;
 }
 
-void bombInfoRequestRecv(BombInfoRequest req, const uint8_t *mac) {
-  BombInfo info = bombInfo();
-  info.request_key = req.key;
-  send(info, mac);
+const uint8_t *bombInfoPayload() {
+  unsigned long displayed_time = displayedTime();
+  if (_bomb_info_dirty || displayed_time != _bomb_info_displayed_time) {
+    encode(bombInfo(), _bomb_info_payload);
+    _bomb_info_displayed_time = displayed_time;
+    _bomb_info_dirty = false;
+  }
+  return _bomb_info_payload;
 }
 
-void sendSolveAttemptAck(SolveAttempt info, const uint8_t *mac) {
-  SolveAttemptAck ack;
-  ack.strike = info.strike;
-  ack.key = info.key;
-  send(ack, mac);
+bool sendBombInfo(const uint8_t *mac, uint32_t request_key) {
+  uint8_t *payload = queueMessage(BOMB_INFO, BombInfoWire::SIZE, mac);
+  if (payload == nullptr)
+    return false;
+  memcpy(payload, bombInfoPayload(), BombInfoWire::SIZE);
+  Wire::Writer<BombInfoWire> writer(payload);
+  writer.set<BombInfoWire::RequestKey>(request_key);
+  return true;
 }
 
-bool isSolveAttemptPending(SolveAttempt info, int module_index) {
-  if (_pending_solve_attempts.find(module_index) ==
-      _pending_solve_attempts.end())
-    return true;
-  if (_pending_solve_attempts[module_index].find(info.key) ==
-      _pending_solve_attempts[module_index].end())
-    return true;
-  return false;
+void bombInfoRequestRecv(BombInfoRequestView req, const uint8_t *mac) {
+  sendBombInfo(mac, req.get<BombInfoRequestWire::Key>());
+}
+
+// A push that finds the TX queue full is retried from update().
+void publishBombInfo() {
+  if (!sendBombInfo(broadcast.peer_addr, 0)) {
+    _bomb_info_changed = true;
+    return;
+  }
+  _bomb_info_changed = false;
+  startTimer(bomb_info_keepalive_timer, BOMB_INFO_KEEPALIVE_DELAY);
+}
+
+void timeSyncRequestRecv(TimeSyncRequestView req, const uint8_t *mac) {
+  TimeSync sync;
+  sync.origin = req.get<TimeSyncRequestWire::Origin>();
+  sync.receive = frameReceivedAt();
+  sync.transmit = Clock::millis();
+  send(sync, mac);
+}
+
+void sendSolveAttemptAck(SolveAttemptView info, const uint8_t *mac) {
+  SolveAttemptAck ack;
+  ack.strike = info.get<SolveAttemptWire::Strike>();
+  ack.key = info.get<SolveAttemptWire::Key>();
+  send(ack, mac);
 }
 
 void strike() {
-  _strikes = min(++_strikes, _max_strikes);
+  _strikes = min(_strikes + 1, _max_strikes);
+  bombInfoChanged();
   if (_strikes >= _max_strikes)
     fail();
   if (onStrike != nullptr)
     onStrike(_strikes);
 }
 
-void solveAttemptRecv(SolveAttempt info, const uint8_t *mac) {
+void solveAttemptRecv(SolveAttemptView info, const uint8_t *mac) {
   sendSolveAttemptAck(info, mac);
-  int module_index = findMacAddress(mac);
+  int module_index = modules.find(mac);
   if (module_index == -1)
     return;
-  if (!isSolveAttemptPending(info, module_index))
+  uint32_t key = info.get<SolveAttemptWire::Key>();
+  if (!modules_solve_attempts[module_index].accept(key)) {
+    Stats::duplicate(SOLVE_ATTEMPT, mac);
     return;
-  _pending_solve_attempts[module_index].insert(info.key);
-  if (info.strike) {
+  }
+  if (info.get<SolveAttemptWire::Strike>()) {
     strike();
     return;
   }
-  if (info.fail) {
+  if (info.get<SolveAttemptWire::Fail>()) {
     fail();
     return;
   }
-  modules_solved[module_index] = true;
-  bool is_solved = true;
-  for (int i = 0; i < modules_connected; i++)
-    if (!modules_solved[i] && modules_types[i] == Puzzle)
-      is_solved = false;
-  if (is_solved)
+  if (modules_types[module_index] == Puzzle &&
+      !modules_solved.test(module_index)) {
+    solved_puzzle_modules++;
+    bombInfoChanged();
+  }
+  modules_solved.set(module_index);
+  if (modules_solved.contains(puzzle_modules))
     solve();
 }
 
 void resetAckRecv(const uint8_t *mac) {
-  int module_index = findMacAddress(mac);
-  if (module_index == -1 || modules_reset[module_index])
+  int module_index = modules.find(mac);
+  if (module_index == -1)
     return;
-  modules_reset[module_index] = true;
-  bool all_modules_reset = true;
-  for (int i = 0; i < modules_connected; i++)
-    if (!modules_reset[i])
-      all_modules_reset = false;
-  if (!all_modules_reset)
+  if (modules_reset.test(module_index)) {
+    Stats::duplicate(RESET_ACK, mac);
     return;
-  _should_reset = false;
+  }
+  if (!_reset_retransmitted)
+    Stats::roundTrip(Stats::RESET_RTT, frameReceivedAt() - _reset_sent_at);
+  modules_reset.set(module_index);
+  if (modules_reset.count() == modules.size())
+    stopTimer(reset_retry_timer);
 }
 
-void startAckRecv(const uint8_t *mac) {
-  if (started())
+unsigned long suspectAt(int module_index) {
+  return modules_liveness[module_index].suspectAt(PHI_THRESHOLD,
+                                                  PHI_MIN_STDDEV);
+}
+
+void scheduleLivenessCheck() {
+  if (!_liveness)
     return;
-  int module_index = findMacAddress(mac);
-  if (module_index == -1 || modules_started[module_index])
+  unsigned long now = Clock::millis();
+  unsigned long next = LIVENESS_HEARTBEAT_DELAY;
+  for (int i = 0; i < modules.size(); i++) {
+    if (modules_suspected.test(i))
+      continue;
+    long left = suspectAt(i) - now;
+    next = min(next, left > 0 ? (unsigned long)left : 0);
+  }
+  startTimer(liveness_timer, next);
+}
+
+void checkLiveness() {
+  unsigned long now = Clock::millis();
+  for (int i = 0; i < modules.size(); i++) {
+    if (modules_suspected.test(i) || (long)(now - suspectAt(i)) < 0)
+      continue;
+    modules_suspected.set(i);
+    if (onSuspected != nullptr)
+      onSuspected(modules.mac(i));
+  }
+  scheduleLivenessCheck();
+}
+
+// Starts watching the modules, as if they had all just answered.
+void startLiveness() {
+  unsigned long now = Clock::millis();
+  _liveness = true;
+  for (int i = 0; i < modules.size(); i++)
+    modules_liveness[i].clear(now, LIVENESS_HEARTBEAT_DELAY);
+  modules_suspected.clear();
+  startTimer(heartbeat_timer, LIVENESS_HEARTBEAT_DELAY,
+             LIVENESS_HEARTBEAT_DELAY);
+  scheduleLivenessCheck();
+}
+
+void beginGame() {
+  stopTimer(start_retry_timer);
+  _start_time = Clock::millis();
+  _last_update_time = Clock::millis();
+  _started = true;
+  startLiveness();
+  bombInfoChanged();
+}
+
+void startAckRecv(const uint8_t *mac) {
+  int module_index = modules.find(mac);
+  if (module_index == -1)
     return;
-  modules_started[module_index] = true;
-  bool all_modules_started = true;
-  for (int i = 0; i < modules_connected; i++)
-    if (!modules_started[i])
-      all_modules_started = false;
-  if (!all_modules_started)
+  if (modules_started.test(module_index)) {
+    Stats::duplicate(START_ACK, mac);
     return;
-  _start_time = millis();
-  _last_update_time = millis();
-  _started = true;
+  }
+  // Acks to a retransmit could answer either START.
+  if (!_start_retransmitted)
+    Stats::roundTrip(Stats::START_RTT, frameReceivedAt() - _start_sent_at);
+  modules_started.set(module_index);
+  if (!started() && modules_started.count() == modules.size())
+    beginGame();
+}
+
+void moveModuleBit(Bitset<MAX_MODULES> &bits, int from, int to) {
+  if (bits.test(from))
+    bits.set(to);
+  else
+    bits.reset(to);
+  bits.reset(from);
+}
+
+// Forgets the module at `index` and its transport peer. As in the peer table,
+// the last module takes over the index.
+void evictModule(int index) {
+  uint8_t mac[MAC_ADDRESS_SIZE];
+  memcpy(mac, modules.mac(index), MAC_ADDRESS_SIZE);
+  removePeer(mac);
+  if (modules_types[index] == Needy)
+    total_needy_modules--;
+  int last = modules.size() - 1;
+  modules.remove(mac);
+  modules_types[index] = modules_types[last];
+  modules_solve_attempts[index] = modules_solve_attempts[last];
+  modules_boots[index] = modules_boots[last];
+  modules_liveness[index] = modules_liveness[last];
+  modules_heartbeats[index] = modules_heartbeats[last];
+  modules_heartbeats_count[index] = modules_heartbeats_count[last];
+  modules_last_seen[index] = modules_last_seen[last];
+  moveModuleBit(modules_solved, last, index);
+  moveModuleBit(modules_started, last, index);
+  moveModuleBit(modules_reset, last, index);
+  moveModuleBit(puzzle_modules, last, index);
+  moveModuleBit(modules_suspected, last, index);
+  moveModuleBit(modules_answered, last, index);
+  _heartbeat_modules = min(_heartbeat_modules, modules.size());
+  total_puzzle_modules = puzzle_modules.count();
+  solved_puzzle_modules = 0;
+  for (int i = 0; i < modules.size(); i++)
+    if (puzzle_modules.test(i) && modules_solved.test(i))
+      solved_puzzle_modules++;
+  bombInfoChanged();
+}
+
+// Evicts the modules missing from `acked`, then lets the barriers and the
+// bomb go on without them.
+void evictMissing(const Bitset<MAX_MODULES> &acked) {
+  for (int i = modules.size() - 1; i >= 0; i--)
+    if (!acked.test(i))
+      evictModule(i);
+  if (start_retry_timer.running() && !started() &&
+      modules_started.count() == modules.size())
+    beginGame();
+  if (total_puzzle_modules > 0 && modules_solved.contains(puzzle_modules))
+    solve();
+}
+
+// Registers a module not known yet and returns its index, or -1.
+int addModule(ModuleType type, const uint8_t *mac) {
+  if (modules.full())
+    return -1;
+  esp_now_peer_info_t peer;
+  if (!tryConnectingToPeer(mac, &peer))
+    return -1;
+  int module_index = modules.add(mac);
+  modules_types[module_index] = type;
+  modules_solve_attempts[module_index].clear();
+  modules_heartbeats_count[module_index] = 0;
+  modules_last_seen[module_index] = frameReceivedAt();
+  if (type == Puzzle) {
+    puzzle_modules.set(module_index);
+    total_puzzle_modules++;
+  }
+  if (type == Needy)
+    total_needy_modules++;
+  bombInfoChanged();
+  _beacon_delay = BEACON_MIN_DELAY;
+  startTimer(beacon_timer, jitter(_beacon_delay));
+  return module_index;
 }
 
 void heartbeatAckRecv(ModuleType type, const uint8_t *mac) {
-  if (findMacAddress(mac) != -1)
+  // The sender held its ack until its slot, which is not part of the round
+  // trip. An ack that came before the slot answered an earlier heartbeat.
+  unsigned long rtt = frameReceivedAt() - _heartbeat_sent_at;
+  unsigned long slot = ackSlotStart(mac, ackSlotsInUse());
+  if (!_heartbeat_timed && rtt >= slot) {
+    Stats::roundTrip(Stats::HEARTBEAT_RTT, rtt - slot);
+    _heartbeat_timed = true;
+  }
+  int module_index = modules.find(mac);
+  if (module_index == -1) {
+    if (!started())
+      addModule(type, mac);
     return;
-  if (!tryConnectingToPeer(mac, &modules[modules_connected++]))
-    modules_connected--;
-  else
-    modules_types[modules_connected - 1] = type;
+  }
+  modules_answered.set(module_index);
+  if (!_liveness)
+    return;
+  modules_liveness[module_index].heartbeat(frameReceivedAt());
+  modules_suspected.reset(module_index);
+  scheduleLivenessCheck();
+}
+
+// Modules joining a running game are answered but not counted, as they were
+// never started.
+void announceRecv(AnnounceView info, const uint8_t *mac) {
+  int module_index = modules.find(mac);
+  if (module_index == -1 && !started())
+    module_index = addModule((ModuleType)info.get<AnnounceWire::Type>(), mac);
+  if (module_index == -1)
+    return;
+  uint32_t boot = info.get<AnnounceWire::Boot>();
+  if (boot != modules_boots[module_index]) {
+    modules_boots[module_index] = boot;
+    modules_solve_attempts[module_index].clear();
+  }
+  if (info.get<AnnounceWire::Connected>())
+    return;
+  Connection connection;
+  memcpy(connection.mac_address, mac_address, MAC_ADDRESS_SIZE);
+  connection.ack_slots = ackSlotsInUse();
+  send(connection, mac);
 }
 
-void setMaxStrikes(int max_strikes) { _max_strikes = max_strikes; }
+void setMaxStrikes(int max_strikes) {
+  _max_strikes = max_strikes;
+  bombInfoChanged();
+}
 
-void setDuration(unsigned long duration) { _duration = duration; }
+void setDuration(unsigned long duration) {
+  _duration = duration;
+  bombInfoChanged();
+}
 
+// Starts a new game with the modules already known.
 void initialize() {
-  for (int i = 0; i < modules_connected; i++)
-    esp_now_del_peer(modules[i].peer_addr);
-  modules_connected = 0;
-
-  _should_reset = false;
+  stopTimer(start_timer);
+  stopTimer(start_retry_timer);
+  stopTimer(heartbeat_timer);
+  stopTimer(liveness_timer);
+  _liveness = false;
+  modules_suspected.clear();
 
   _should_start_at = 0;
   _started = false;
@@ -288,68 +604,198 @@ void initialize() {
   for (int i = 0; i < SPEED_STAGES; i++)
     _elapsed_time[i] = 0;
 
-  for (int i = 0; i < MAX_MODULES; i++) {
-    modules_solved[i] = false;
-    modules_started[i] = false;
-    modules_reset[i] = false;
+  modules_solved.clear();
+  modules_started.clear();
+  for (int i = 0; i < modules.size(); i++)
+    modules_solve_attempts[i].clear();
+  solved_puzzle_modules = 0;
+  bombInfoChanged();
+}
+
+struct MainModuleHandlers : Handlers {
+  // Frames from the previous games are stale. Modules only learn the epoch
+  // once connected, so the frames of those that just restarted carry any.
+  static bool onFrame(const uint8_t *mac, uint16_t frame_epoch) {
+    int module_index = modules.find(mac);
+    if (module_index != -1)
+      modules_last_seen[module_index] = frameReceivedAt();
+    return !staleEpoch(frame_epoch);
   }
+  static void onBombInfoRequest(BombInfoRequestView req, const uint8_t *mac) {
+    bombInfoRequestRecv(req, mac);
+  }
+  static void onSolveAttempt(SolveAttemptView info, const uint8_t *mac) {
+    solveAttemptRecv(info, mac);
+  }
+  static void onStartAck(const uint8_t *mac) { startAckRecv(mac); }
+  static void onResetAck(const uint8_t *mac) { resetAckRecv(mac); }
+  static void onTimeSyncRequest(TimeSyncRequestView req, const uint8_t *mac) {
+    timeSyncRequestRecv(req, mac);
+  }
+  static void onHeartbeatAck(HeartbeatAckView ack, const uint8_t *mac) {
+    heartbeatAckRecv((ModuleType)ack.get<HeartbeatAckWire::Type>(), mac);
+  }
+  static void onAnnounce(AnnounceView info, const uint8_t *mac) {
+    announceRecv(info, mac);
+  }
+};
+
+uint16_t bootEpoch() {
+  epoch_storage.begin(EPOCH_NAMESPACE, true);
+  bool stored = epoch_storage.isKey(EPOCH_KEY);
+  uint16_t last = epoch_storage.getUInt(EPOCH_KEY);
+  epoch_storage.end();
+  return stored ? last + STALE_EPOCHS + 1 : esp_random();
+}
 
-  _pending_solve_attempts.clear();
+void moveToEpoch(uint16_t epoch) {
+  setEpoch(epoch);
+  epoch_storage.begin(EPOCH_NAMESPACE, false);
+  epoch_storage.putUInt(EPOCH_KEY, epoch);
+  epoch_storage.end();
 }
 
 bool setup() {
+  _bomb_info_sequence = esp_random();
+  moveToEpoch(bootEpoch());
   initialize();
 
-  Callbacks callbacks;
-  callbacks.bombInfoRequestCallback = bombInfoRequestRecv;
-  callbacks.solveAttemptCallback = solveAttemptRecv;
-  callbacks.startAckCallback = startAckRecv;
-  callbacks.resetAckCallback = resetAckRecv;
-  callbacks.heartbeatAckCallback = heartbeatAckRecv;
-
-  if (!initProtocol("Main Module", callbacks, Main))
+  if (!initProtocol<MainModuleHandlers>("Main Module", Main))
     return false;
 
   if (OTA::running())
     return true;
 
-  mac_address = WiFi.macAddress();
+  WiFi.macAddress(mac_address);
 
-  uint8_t broadcastAddress[] = {0xff, 0xff, 0xff, 0xff, 0xff, 0xff};
-  if (!tryConnectingToPeer(broadcastAddress, &broadcast))
+  if (!tryConnectingToPeer(BROADCAST_ADDRESS, &broadcast))
     return false;
 
+  _beacon_delay = BEACON_MIN_DELAY;
+  startTimer(beacon_timer, 0);
   return true;
 }
 
 void startAfter(int seconds) {
-  _should_start_at = millis() + seconds * ONE_SECOND;
+  _should_start_at = Clock::millis() + seconds * ONE_SECOND;
+  startTimer(heartbeat_timer, 0, HEARTBEAT_DELAY);
+  // starting() turns true the tick after _should_start_at.
+  startTimer(start_timer, seconds * ONE_SECOND + 1);
 }
 
+// Sends `type` to the known modules missing from `acked` and returns how long
+// their answers take at most: up to the last of their ack slots.
+unsigned long sendToMissing(MessageType type,
+                            const Bitset<MAX_MODULES> &acked) {
+  if (modules.size() - acked.count() > BARRIER_UNICAST_MAX) {
+    send(type, broadcast.peer_addr);
+    return ackWindow(ackSlotsInUse());
+  }
+  unsigned long window = 0;
+  for (int i = 0; i < modules.size(); i++) {
+    if (acked.test(i))
+      continue;
+    send(type, modules.mac(i));
+    unsigned long slot = ackSlotStart(modules.mac(i), ackSlotsInUse());
+    window = max(window, slot + ACK_SLOT);
+  }
+  return window;
+}
+
+// Modules the game ended with suspected are taken for gone right away rather
+// than after the RESET barrier times out on them.
 void reset() {
+  for (int i = modules.size() - 1; i >= 0; i--)
+    if (modules_suspected.test(i))
+      evictModule(i);
   initialize();
-  _should_reset = true;
+  moveToEpoch(epoch() + 1);
+  modules_reset.clear();
+  stopTimer(reset_retry_timer);
+  startTimer(reset_timer, 0);
+}
+
+void broadcastReset() {
+  if (send(RESET, broadcast.peer_addr) != ESP_OK) {
+    startTimer(reset_timer, SEND_RETRY_DELAY);
+    return;
+  }
+  _reset_sent_at = Clock::millis();
+  _reset_retransmitted = false;
+  startTimer(reset_retry_timer, ackWindow(ackSlotsInUse()) + RESET_RETRY_DELAY);
+}
+
+void retransmitReset() {
+  if (modules_reset.count() == modules.size()) {
+    stopTimer(reset_retry_timer);
+    return;
+  }
+  if (Clock::millis() - _reset_sent_at >= RESET_BARRIER_TIMEOUT) {
+    stopTimer(reset_retry_timer);
+    evictMissing(modules_reset);
+    return;
+  }
+  _reset_retransmitted = true;
+  startTimer(reset_retry_timer,
+             sendToMissing(RESET, modules_reset) + RESET_RETRY_DELAY);
 }
 
-esp_err_t broadcastMacAddress() {
+void broadcastStart() {
+  stopTimer(heartbeat_timer);
+  if (send(START, broadcast.peer_addr) != ESP_OK) {
+    startTimer(start_timer, SEND_RETRY_DELAY);
+    return;
+  }
+  _start_sent_at = Clock::millis();
+  _start_retransmitted = false;
+  startTimer(start_retry_timer, ackWindow(ackSlotsInUse()) + START_RETRY_DELAY);
+}
+
+void retransmitStart() {
+  if (Clock::millis() - _start_sent_at >= START_BARRIER_TIMEOUT) {
+    beginGame();
+    return;
+  }
+  _start_retransmitted = true;
+  startTimer(start_retry_timer,
+             sendToMissing(START, modules_started) + START_RETRY_DELAY);
+}
+
+void sendHeartbeat() {
+  if (send(HEARTBEAT, broadcast.peer_addr) != ESP_OK)
+    return;
+  _heartbeat_sent_at = Clock::millis();
+  _heartbeat_timed = false;
+  for (int i = 0; i < _heartbeat_modules; i++) {
+    modules_heartbeats[i] =
+        modules_heartbeats[i] << 1 | (modules_answered.test(i) ? 1 : 0);
+    if (modules_heartbeats_count[i] < HEARTBEAT_HISTORY)
+      modules_heartbeats_count[i]++;
+  }
+  modules_answered.clear();
+  _heartbeat_modules = modules.size();
+}
+
+void broadcastMacAddress() {
   Connection info;
-  strcpy(info.mac_address, mac_address.c_str());
-  return send(info, broadcast.peer_addr);
+  memcpy(info.mac_address, mac_address, MAC_ADDRESS_SIZE);
+  info.ack_slots = ackSlotsInUse();
+  if (send(info, broadcast.peer_addr) != ESP_OK) {
+    startTimer(beacon_timer, SEND_RETRY_DELAY);
+    return;
+  }
+  startTimer(beacon_timer, jitter(_beacon_delay));
+  _beacon_delay = min(2 * _beacon_delay, BEACON_MAX_DELAY);
 }
 
 void update() {
   OTA::update();
+  updateProtocol();
 
   updateMissingTime();
-  broadcast_debouncer([&]() { broadcastMacAddress(); });
-  if (onStartCountdown())
-    heartbeat_debouncer([&]() { send(HEARTBEAT, broadcast.peer_addr); });
-  if (starting())
-    start_debouncer_quick([&]() { send(START, broadcast.peer_addr); });
-  if (started())
-    start_debouncer_slow([&]() { send(START, broadcast.peer_addr); });
-  if (_should_reset)
-    reset_debouncer([&]() { send(RESET, broadcast.peer_addr); });
+  if (_bomb_info_changed)
+    publishBombInfo();
+  flushMessages();
 }
 
 int speed() { return min(_strikes, SPEED_STAGES - 1); }
@@ -4,16 +4,30 @@
 #include <bomb_protocol.h>
 
 namespace MainModule {
-const int MAX_MODULES = 15;
-const int SPEED_STAGES = 4;
+const int MAX_MODULES = MAX_PEERS;
+using ::SPEED_STAGES;
 
-using OnSolved = std::function<void()>;
-using OnFailed = std::function<void()>;
-using OnStrike = std::function<void(int strikes)>;
+using OnSolved = Callback<void(), CALLBACK_SIZE>;
+using OnFailed = Callback<void(), CALLBACK_SIZE>;
+using OnStrike = Callback<void(int strikes), CALLBACK_SIZE>;
+using OnSuspected = Callback<void(const uint8_t *mac), CALLBACK_SIZE>;
 
-extern OnSolved onSolved;
-extern OnFailed onFailed;
-extern OnStrike onStrike;
+extern NODE_LOCAL OnSolved onSolved;
+extern NODE_LOCAL OnFailed onFailed;
+extern NODE_LOCAL OnStrike onStrike;
+// Called when a module stops answering the heartbeats of the game, once until
+// it answers again. Modules still suspected at the next reset() are evicted.
+extern NODE_LOCAL OnSuspected onSuspected;
+
+struct ModuleHealth {
+  // Clock::millis() when the last frame of the module arrived.
+  unsigned long last_seen;
+  // Phi of its failure detector, 0 before the game starts.
+  float suspicion;
+  // Share of the last heartbeats it did not answer.
+  float loss_rate;
+  bool suspected;
+};
 
 bool setup();
 void update();
@@ -26,6 +40,13 @@ void reset();
 
 BombInfo bombInfo();
 
+// Modules known, numbered from 0 in the order they joined; an evicted module's
+// number goes to the last one. moduleMac() returns nullptr and moduleHealth()
+// all zeros for numbers out of range.
+int moduleCount();
+const uint8_t *moduleMac(int index);
+ModuleHealth moduleHealth(int index);
+
 int strikes();
 int maxStrikes();
 
@@ -38,8 +59,9 @@ bool failed();
 int code();
 
 int speed();
-char *timeStr(bool);
-char *timeStrToStart();
+// Format into a buffer of at least TIME_LENGTH + 1 chars.
+void timeStr(char *buffer, bool show_millis = true);
+void timeStrToStart(char *buffer);
 unsigned long timeToNextSecond();
 } // namespace MainModule
 
@@ -0,0 +1,364 @@
+#ifndef MESSAGES_H
+#define MESSAGES_H
+
+#include <Arduino.h>
+#include <transport/transport.h>
+#include <wire.h>
+
+// Bumped on every change to the wire format. Frames from other versions are
+// ignored, so mixed firmware does not misread each other.
+const uint8_t PROTOCOL_VERSION = 8;
+
+const int TIME_LENGTH = 5;
+
+// After each strike the countdown runs faster, SPEED_STAGES / (SPEED_STAGES -
+// speed) times real time, speed being the strikes so far capped at
+// SPEED_STAGES - 1.
+const int SPEED_STAGES = 4;
+
+// A frame is the protocol version, a flags byte and the sender's epoch, little
+// endian, followed by a sequence of messages, each one a length byte, the
+// message type and its payload. The epoch numbers games: the main module bumps
+// it on every reset and modules follow it. FRAME_ADDRESSED frames are
+// broadcast and put their destination MAC right after the header; they reach
+// peers the transport has no unicast slot for.
+const int FRAME_HEADER_SIZE = 4;
+const int MESSAGE_HEADER_SIZE = 2;
+const uint8_t FRAME_ADDRESSED = 0x01;
+const int MAX_PAYLOAD_SIZE =
+    MAX_FRAME_SIZE - FRAME_HEADER_SIZE - MAC_ADDRESS_SIZE - MESSAGE_HEADER_SIZE;
+
+enum ModuleType {
+  Main,
+  Puzzle,
+  Needy,
+  Spectator,
+};
+
+typedef struct BombInfo {
+  uint32_t request_key;
+  uint16_t sequence;
+  char time[TIME_LENGTH + 1];
+  uint8_t strikes, max_strikes;
+  bool failed, solved;
+  uint16_t code;
+  uint8_t total_puzzle_modules, solved_puzzle_modules;
+  uint8_t total_needy_modules;
+  // The countdown had elapsed timer_elapsed ms at timer_anchor on the main
+  // module's clock, and moves on at the rate of `speed` while running.
+  uint32_t timer_anchor, timer_elapsed, duration;
+  uint8_t speed;
+  bool running;
+  // Ack slots the main module lays out, see ACK_SLOT.
+  uint8_t ack_slots;
+} BombInfo;
+
+typedef struct BombInfoRequest {
+  uint32_t key;
+} BombInfoRequest;
+
+typedef struct Connection {
+  uint8_t mac_address[MAC_ADDRESS_SIZE];
+  uint8_t ack_slots;
+} Connection;
+
+typedef struct SolveAttempt {
+  bool strike;
+  uint32_t key;
+  bool fail;
+} SolveAttempt;
+
+typedef struct SolveAttemptAck {
+  bool strike;
+  uint32_t key;
+} SolveAttemptAck;
+
+typedef struct HeartbeatAck {
+  ModuleType type;
+} HeartbeatAck;
+
+// Sent by a module looking for the main module, which registers it and
+// answers with a CONNECTION unless the module is `connected` already. `boot`
+// changes every time the module starts.
+typedef struct Announce {
+  ModuleType type;
+  bool connected;
+  uint32_t boot;
+} Announce;
+
+// NTP-style exchange, all times on the sender's millis() clock: the module
+// sends `origin`, the main module answers with it and the times it received
+// the request and sent the answer.
+typedef struct TimeSyncRequest {
+  uint32_t origin;
+} TimeSyncRequest;
+
+typedef struct TimeSync {
+  uint32_t origin, receive, transmit;
+} TimeSync;
+
+enum MessageType {
+  UNKNOWN,
+  CONNECTION,
+  BOMB_INFO,
+  BOMB_INFO_REQUEST,
+  SOLVE_ATTEMPT,
+  SOLVE_ATTEMPT_ACK,
+  START,
+  START_ACK,
+  RESET,
+  RESET_ACK,
+  HEARTBEAT,
+  HEARTBEAT_ACK,
+  TIME_SYNC_REQUEST,
+  TIME_SYNC,
+  ANNOUNCE,
+};
+
+const int MESSAGE_TYPES = ANNOUNCE + 1;
+
+struct BombInfoWire {
+  using RequestKey = Wire::Field<uint32_t>;
+  using Sequence = Wire::Field<uint16_t, RequestKey>;
+  using Time = Wire::Bytes<TIME_LENGTH, Sequence>;
+  using Strikes = Wire::Field<uint8_t, Time>;
+  using MaxStrikes = Wire::Field<uint8_t, Strikes>;
+  using Failed = Wire::Field<bool, MaxStrikes>;
+  using Solved = Wire::Field<bool, Failed>;
+  using Code = Wire::Field<uint16_t, Solved>;
+  using TotalPuzzleModules = Wire::Field<uint8_t, Code>;
+  using SolvedPuzzleModules = Wire::Field<uint8_t, TotalPuzzleModules>;
+  using TotalNeedyModules = Wire::Field<uint8_t, SolvedPuzzleModules>;
+  using TimerAnchor = Wire::Field<uint32_t, TotalNeedyModules>;
+  using TimerElapsed = Wire::Field<uint32_t, TimerAnchor>;
+  using Duration = Wire::Field<uint32_t, TimerElapsed>;
+  using Speed = Wire::Field<uint8_t, Duration>;
+  using Running = Wire::Field<bool, Speed>;
+  using AckSlots = Wire::Field<uint8_t, Running>;
+  static constexpr size_t SIZE = AckSlots::END;
+};
+
+struct BombInfoRequestWire {
+  using Key = Wire::Field<uint32_t>;
+  static constexpr size_t SIZE = Key::END;
+};
+
+struct ConnectionWire {
+  using MacAddress = Wire::Bytes<MAC_ADDRESS_SIZE>;
+  using AckSlots = Wire::Field<uint8_t, MacAddress>;
+  static constexpr size_t SIZE = AckSlots::END;
+};
+
+struct SolveAttemptWire {
+  using Key = Wire::Field<uint32_t>;
+  using Strike = Wire::Field<bool, Key>;
+  using Fail = Wire::Field<bool, Strike>;
+  static constexpr size_t SIZE = Fail::END;
+};
+
+struct SolveAttemptAckWire {
+  using Key = Wire::Field<uint32_t>;
+  using Strike = Wire::Field<bool, Key>;
+  static constexpr size_t SIZE = Strike::END;
+};
+
+struct HeartbeatAckWire {
+  using Type = Wire::Field<uint8_t>;
+  static constexpr size_t SIZE = Type::END;
+};
+
+struct AnnounceWire {
+  using Type = Wire::Field<uint8_t>;
+  using Connected = Wire::Field<bool, Type>;
+  using Boot = Wire::Field<uint32_t, Connected>;
+  static constexpr size_t SIZE = Boot::END;
+};
+
+struct TimeSyncRequestWire {
+  using Origin = Wire::Field<uint32_t>;
+  static constexpr size_t SIZE = Origin::END;
+};
+
+struct TimeSyncWire {
+  using Origin = Wire::Field<uint32_t>;
+  using Receive = Wire::Field<uint32_t, Origin>;
+  using Transmit = Wire::Field<uint32_t, Receive>;
+  static constexpr size_t SIZE = Transmit::END;
+};
+
+// Views read the received frame in place and are only valid inside the
+// handler they are passed to.
+using ConnectionView = Wire::View<ConnectionWire>;
+using BombInfoView = Wire::View<BombInfoWire>;
+using BombInfoRequestView = Wire::View<BombInfoRequestWire>;
+using SolveAttemptView = Wire::View<SolveAttemptWire>;
+using SolveAttemptAckView = Wire::View<SolveAttemptAckWire>;
+using HeartbeatAckView = Wire::View<HeartbeatAckWire>;
+using AnnounceView = Wire::View<AnnounceWire>;
+using TimeSyncRequestView = Wire::View<TimeSyncRequestWire>;
+using TimeSyncView = Wire::View<TimeSyncWire>;
+
+BombInfo decode(BombInfoView view);
+
+void encode(const Connection &info, uint8_t *payload);
+void encode(const BombInfo &info, uint8_t *payload);
+void encode(const BombInfoRequest &info, uint8_t *payload);
+void encode(const SolveAttempt &info, uint8_t *payload);
+void encode(const SolveAttemptAck &info, uint8_t *payload);
+void encode(const HeartbeatAck &info, uint8_t *payload);
+void encode(const Announce &info, uint8_t *payload);
+void encode(const TimeSyncRequest &info, uint8_t *payload);
+void encode(const TimeSync &info, uint8_t *payload);
+
+// Compile-time registry of the messages: Message<TYPE>::Schema is the payload
+// layout and Message<TYPE>::handle passes a received payload to the matching
+// static member of a handler set, see Handlers in bomb_protocol.h.
+// MessageFor<T>::TYPE maps a payload struct back to its message type.
+template <MessageType TYPE> struct Message {
+  using Schema = Wire::Empty;
+  template <typename H>
+  static void handle(Wire::View<Schema> info, const uint8_t *mac) {}
+};
+
+template <typename T> struct MessageFor;
+
+template <> struct Message<CONNECTION> {
+  using Schema = ConnectionWire;
+  template <typename H>
+  static void handle(ConnectionView info, const uint8_t *mac) {
+    H::onConnection(info, mac);
+  }
+};
+template <> struct MessageFor<Connection> {
+  static const MessageType TYPE = CONNECTION;
+};
+
+template <> struct Message<BOMB_INFO> {
+  using Schema = BombInfoWire;
+  template <typename H>
+  static void handle(BombInfoView info, const uint8_t *mac) {
+    H::onBombInfo(decode(info), mac);
+  }
+};
+template <> struct MessageFor<BombInfo> {
+  static const MessageType TYPE = BOMB_INFO;
+};
+
+template <> struct Message<BOMB_INFO_REQUEST> {
+  using Schema = BombInfoRequestWire;
+  template <typename H>
+  static void handle(BombInfoRequestView info, const uint8_t *mac) {
+    H::onBombInfoRequest(info, mac);
+  }
+};
+template <> struct MessageFor<BombInfoRequest> {
+  static const MessageType TYPE = BOMB_INFO_REQUEST;
+};
+
+template <> struct Message<SOLVE_ATTEMPT> {
+  using Schema = SolveAttemptWire;
+  template <typename H>
+  static void handle(SolveAttemptView info, const uint8_t *mac) {
+    H::onSolveAttempt(info, mac);
+  }
+};
+template <> struct MessageFor<SolveAttempt> {
+  static const MessageType TYPE = SOLVE_ATTEMPT;
+};
+
+template <> struct Message<SOLVE_ATTEMPT_ACK> {
+  using Schema = SolveAttemptAckWire;
+  template <typename H>
+  static void handle(SolveAttemptAckView info, const uint8_t *mac) {
+    H::onSolveAttemptAck(info);
+  }
+};
+template <> struct MessageFor<SolveAttemptAck> {
+  static const MessageType TYPE = SOLVE_ATTEMPT_ACK;
+};
+
+template <> struct Message<START> {
+  using Schema = Wire::Empty;
+  template <typename H>
+  static void handle(Wire::View<Schema> info, const uint8_t *mac) {
+    H::onStart();
+  }
+};
+
+template <> struct Message<START_ACK> {
+  using Schema = Wire::Empty;
+  template <typename H>
+  static void handle(Wire::View<Schema> info, const uint8_t *mac) {
+    H::onStartAck(mac);
+  }
+};
+
+template <> struct Message<RESET> {
+  using Schema = Wire::Empty;
+  template <typename H>
+  static void handle(Wire::View<Schema> info, const uint8_t *mac) {
+    H::onReset();
+  }
+};
+
+template <> struct Message<RESET_ACK> {
+  using Schema = Wire::Empty;
+  template <typename H>
+  static void handle(Wire::View<Schema> info, const uint8_t *mac) {
+    H::onResetAck(mac);
+  }
+};
+
+template <> struct Message<HEARTBEAT> {
+  using Schema = Wire::Empty;
+  template <typename H>
+  static void handle(Wire::View<Schema> info, const uint8_t *mac) {
+    H::onHeartbeat(mac);
+  }
+};
+
+template <> struct Message<HEARTBEAT_ACK> {
+  using Schema = HeartbeatAckWire;
+  template <typename H>
+  static void handle(HeartbeatAckView info, const uint8_t *mac) {
+    H::onHeartbeatAck(info, mac);
+  }
+};
+template <> struct MessageFor<HeartbeatAck> {
+  static const MessageType TYPE = HEARTBEAT_ACK;
+};
+
+template <> struct Message<TIME_SYNC_REQUEST> {
+  using Schema = TimeSyncRequestWire;
+  template <typename H>
+  static void handle(TimeSyncRequestView info, const uint8_t *mac) {
+    H::onTimeSyncRequest(info, mac);
+  }
+};
+template <> struct MessageFor<TimeSyncRequest> {
+  static const MessageType TYPE = TIME_SYNC_REQUEST;
+};
+
+template <> struct Message<TIME_SYNC> {
+  using Schema = TimeSyncWire;
+  template <typename H>
+  static void handle(TimeSyncView info, const uint8_t *mac) {
+    H::onTimeSync(info, mac);
+  }
+};
+template <> struct MessageFor<TimeSync> {
+  static const MessageType TYPE = TIME_SYNC;
+};
+
+template <> struct Message<ANNOUNCE> {
+  using Schema = AnnounceWire;
+  template <typename H>
+  static void handle(AnnounceView info, const uint8_t *mac) {
+    H::onAnnounce(info, mac);
+  }
+};
+template <> struct MessageFor<Announce> {
+  static const MessageType TYPE = ANNOUNCE;
+};
+
+#endif // MESSAGES_H
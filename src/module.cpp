@@ -1,67 +1,398 @@
-#include <map>
-#include <set>
+#include <Preferences.h>
 
 #include <module.h>
 #include <ota.h>
-#include <utils/debouncer.h>
+#include <stats.h>
+#include <utils/clock_sync.h>
+#include <utils/ring_buffer.h>
+#include <utils/rtt_estimator.h>
 
 namespace Module {
-ModuleType _type;
+NODE_LOCAL ModuleType _type;
 
-const int BOMB_INFO_DELAY = 50;
-unsigned long _last_bomb_info_request = 0;
-int _bomb_info_key_index = 0;
-std::map<int, BombInfoCallback> _bomb_info_callbacks_map;
-Debouncer _bomb_info_debouncer(BOMB_INFO_DELAY);
+void updateBombInfoRequest();
+void syncClock();
+void sendSolveAttempts();
+void announce();
+void sendAcks();
 
-const int UPDATE_MANUAL_CODE_DELAY = 200;
-Debouncer _update_manual_code_debouncer(UPDATE_MANUAL_CODE_DELAY);
+// How soon a message the TX queue had no room for is tried again.
+const unsigned long SEND_RETRY_DELAY = 5;
 
-String _mac_address;
-esp_now_peer_info_t _main_module;
+// Callers waiting for BOMB_INFO share a single outstanding request, which is
+// retried every BOMB_INFO_RETRY_DELAY until answered or out of attempts. A key
+// of 0 means no request is in flight.
+const unsigned long BOMB_INFO_RETRY_DELAY = 50;
+const uint8_t BOMB_INFO_MAX_ATTEMPTS = 5;
+struct BombInfoWaiter {
+  BombInfoCallback callback;
+  unsigned long deadline;
+};
+NODE_LOCAL BombInfoWaiter _bomb_info_waiters[BOMB_INFO_WAITERS];
+NODE_LOCAL int _bomb_info_waiters_count;
+NODE_LOCAL uint32_t _bomb_info_key_index = 0;
+NODE_LOCAL uint32_t _bomb_info_request_key;
+NODE_LOCAL uint8_t _bomb_info_request_attempts;
+NODE_LOCAL unsigned long _bomb_info_request_sent_at;
+NODE_LOCAL Timer _bomb_info_request_timer(updateBombInfoRequest);
 
-bool _connected, _started, _solved;
+// Latest BOMB_INFO pushed by the main module. It is trusted until the
+// keepalives stop arriving, after which withBombInfo asks for a fresh copy.
+const unsigned long BOMB_INFO_STALE_DELAY = 2500;
+NODE_LOCAL BombInfo _bomb_info;
+NODE_LOCAL bool _has_bomb_info;
+NODE_LOCAL unsigned long _bomb_info_received_at;
 
-const int SOLVE_ATTEMPT_DELAY = 50;
-int _solve_attempt_key_index = 0;
-std::map<int, SolveAttempt> _pending_solve_attempts;
-Debouncer _solve_attempt_debouncer(SOLVE_ATTEMPT_DELAY);
+// The main module's clock, sampled quickly until the estimate settles and
+// slowly after that, so the countdown can be drawn locally.
+const unsigned long CLOCK_SYNC_FAST_INTERVAL = 250;
+const unsigned long CLOCK_SYNC_INTERVAL = 5000;
+NODE_LOCAL ClockSync _clock;
+NODE_LOCAL Timer _clock_sync_timer(syncClock);
 
-int _code;
+NODE_LOCAL esp_now_peer_info_t _main_module;
+NODE_LOCAL esp_now_peer_info_t _broadcast;
+// Whether _main_module holds a peer registered with the transport, which may
+// be the one remembered from before a power cycle and not connected yet.
+NODE_LOCAL bool _main_module_added;
 
-String name = "Unknown";
-OnRestart onRestart = nullptr;
-OnStart onStart = nullptr;
-OnManualCode onManualCode = nullptr;
+// Until connected, the module announces itself every ANNOUNCE_MIN_DELAY at
+// first and twice as slowly after each try, up to ANNOUNCE_MAX_DELAY. The main
+// module it last connected to is kept in flash and asked directly first, so
+// after a power cycle it answers within a round trip.
+const unsigned long ANNOUNCE_MIN_DELAY = 50;
+const unsigned long ANNOUNCE_MAX_DELAY = 2000;
+const char *PEERS_NAMESPACE = "peers";
+const char *MAIN_MODULE_KEY = "main";
+NODE_LOCAL Timer _announce_timer(announce);
+NODE_LOCAL unsigned long _announce_delay;
+NODE_LOCAL Preferences _peers;
+// Drawn at every boot and sent in ANNOUNCE, so the main module tells a restart
+// from an ANNOUNCE repeated after connecting, even when it missed every
+// ANNOUNCE from before this module connected again.
+NODE_LOCAL uint32_t _boot;
 
-void sendPendingSolveAttempts() {
-  if (_pending_solve_attempts.empty())
+NODE_LOCAL bool _connected, _started, _solved;
+// Epoch of the frame being handled, taken on by the CONNECTION in it.
+NODE_LOCAL uint16_t _frame_epoch;
+
+// Answers to the broadcasts of the main module wait for this module's ack
+// slot and go out together, see ACK_SLOT.
+NODE_LOCAL bool _heartbeat_ack_pending, _start_ack_pending, _reset_ack_pending;
+NODE_LOCAL uint8_t _heartbeat_mac[MAC_ADDRESS_SIZE];
+NODE_LOCAL Timer _ack_timer(sendAcks);
+// As laid out by the main module, from its last CONNECTION or BOMB_INFO.
+NODE_LOCAL int _ack_slots = ACK_DEFAULT_SLOTS;
+
+// Up to SOLVE_ATTEMPT_WINDOW attempts are in flight at once, each acked on its
+// own and retransmitted once the timeout estimated from measured round trips
+// expires. The rest wait in the queue, in order.
+const unsigned long SOLVE_ATTEMPT_INITIAL_RTO = 100;
+const unsigned long SOLVE_ATTEMPT_MIN_RTO = 20;
+const unsigned long SOLVE_ATTEMPT_MAX_RTO = 1000;
+struct OutstandingSolveAttempt {
+  SolveAttempt attempt;
+  unsigned long sent_at;
+  bool retransmitted;
+};
+NODE_LOCAL uint32_t _solve_attempt_key_index = 0;
+NODE_LOCAL RingBuffer<SolveAttempt, SOLVE_ATTEMPT_QUEUE_SIZE>
+    _queued_solve_attempts;
+NODE_LOCAL OutstandingSolveAttempt
+    _outstanding_solve_attempts[SOLVE_ATTEMPT_WINDOW];
+NODE_LOCAL int _outstanding_solve_attempts_count;
+// Set when the main module's radio did not ack a frame, so the attempts in
+// flight go out again right away instead of after the timeout.
+NODE_LOCAL bool _solve_attempts_lost;
+NODE_LOCAL RttEstimator _solve_attempt_rtt(SOLVE_ATTEMPT_INITIAL_RTO,
+                                           SOLVE_ATTEMPT_MIN_RTO,
+                                           SOLVE_ATTEMPT_MAX_RTO);
+NODE_LOCAL Timer _solve_attempt_timer(sendSolveAttempts);
+
+NODE_LOCAL int _code;
+
+NODE_LOCAL const char *name = "Unknown";
+NODE_LOCAL OnRestart onRestart = nullptr;
+NODE_LOCAL OnStart onStart = nullptr;
+NODE_LOCAL OnManualCode onManualCode = nullptr;
+
+// Wakes sendSolveAttempts() when the first attempt in flight times out.
+void scheduleSolveAttempts() {
+  unsigned long now = Clock::millis();
+  unsigned long rto = _solve_attempt_rtt.rto();
+  unsigned long next = rto;
+  for (int i = 0; i < _outstanding_solve_attempts_count; i++) {
+    unsigned long waited = now - _outstanding_solve_attempts[i].sent_at;
+    next = min(next, waited < rto ? rto - waited : 0);
+  }
+  if (_outstanding_solve_attempts_count > 0)
+    startTimer(_solve_attempt_timer, next);
+}
+
+void sendSolveAttempts() {
+  if (!_connected)
     return;
-  SolveAttempt sa = _pending_solve_attempts.begin()->second;
-  send(sa, _main_module.peer_addr);
+  unsigned long now = Clock::millis();
+  bool timed_out = false;
+  for (int i = 0; i < _outstanding_solve_attempts_count; i++) {
+    OutstandingSolveAttempt &outstanding = _outstanding_solve_attempts[i];
+    if (!_solve_attempts_lost &&
+        now - outstanding.sent_at < _solve_attempt_rtt.rto())
+      continue;
+    if (send(outstanding.attempt, _main_module.peer_addr) != ESP_OK) {
+      startTimer(_solve_attempt_timer, SEND_RETRY_DELAY);
+      return;
+    }
+    outstanding.sent_at = now;
+    outstanding.retransmitted = true;
+    timed_out = true;
+  }
+  if (timed_out && !_solve_attempts_lost)
+    _solve_attempt_rtt.backoff();
+  _solve_attempts_lost = false;
+
+  SolveAttempt *attempt;
+  while (_outstanding_solve_attempts_count < SOLVE_ATTEMPT_WINDOW &&
+         (attempt = _queued_solve_attempts.peek()) != nullptr) {
+    if (send(*attempt, _main_module.peer_addr) != ESP_OK) {
+      startTimer(_solve_attempt_timer, SEND_RETRY_DELAY);
+      return;
+    }
+    _outstanding_solve_attempts[_outstanding_solve_attempts_count++] = {
+        *attempt, now, false};
+    _queued_solve_attempts.pop();
+  }
+  scheduleSolveAttempts();
 }
 
-void queueSolveAttempt(SolveAttempt attempt) {
+bool queueSolveAttempt(SolveAttempt attempt) {
+  SolveAttempt *slot = _queued_solve_attempts.reserve();
+  if (slot == nullptr)
+    return false;
   attempt.key = _solve_attempt_key_index++;
-  _pending_solve_attempts[attempt.key] = attempt;
+  *slot = attempt;
+  _queued_solve_attempts.push();
+  startTimer(_solve_attempt_timer, 0);
+  return true;
 }
 
-void solveAttemptAckRecv(SolveAttemptAck ack) {
-  if (_pending_solve_attempts.find(ack.key) == _pending_solve_attempts.end())
+void frameSentRecv(const uint8_t *mac, bool delivered) {
+  if (delivered || !_connected ||
+      memcmp(mac, _main_module.peer_addr, MAC_ADDRESS_SIZE) != 0 ||
+      !sentFrameCarries(SOLVE_ATTEMPT))
     return;
-  _pending_solve_attempts.erase(ack.key);
+  _solve_attempts_lost = true;
+  if (_outstanding_solve_attempts_count > 0)
+    startTimer(_solve_attempt_timer, 0);
+}
+
+void solveAttemptAckRecv(SolveAttemptAckView ack) {
+  uint32_t key = ack.get<SolveAttemptAckWire::Key>();
+  for (int i = 0; i < _outstanding_solve_attempts_count; i++) {
+    OutstandingSolveAttempt &outstanding = _outstanding_solve_attempts[i];
+    if (outstanding.attempt.key != key)
+      continue;
+    if (!outstanding.retransmitted) {
+      _solve_attempt_rtt.sample(Clock::millis() - outstanding.sent_at);
+      Stats::roundTrip(Stats::SOLVE_ATTEMPT_RTT,
+                       frameReceivedAt() - outstanding.sent_at);
+    }
+    outstanding =
+        _outstanding_solve_attempts[--_outstanding_solve_attempts_count];
+    if (_queued_solve_attempts.size() > 0)
+      startTimer(_solve_attempt_timer, 0);
+    return;
+  }
+  Stats::duplicate(SOLVE_ATTEMPT_ACK, _main_module.peer_addr);
+}
+
+bool bombInfoFresh() {
+  return _has_bomb_info &&
+         Clock::millis() - _bomb_info_received_at < BOMB_INFO_STALE_DELAY;
+}
+
+unsigned long remainingTime() {
+  if (!_has_bomb_info)
+    return 0;
+  unsigned long elapsed = _bomb_info.timer_elapsed;
+  if (_bomb_info.running) {
+    uint32_t now = _clock.synced()
+                       ? _clock.remoteTime(Clock::millis())
+                       : _bomb_info.timer_anchor +
+                             (Clock::millis() - _bomb_info_received_at);
+    int32_t since = (int32_t)(now - _bomb_info.timer_anchor);
+    if (since > 0)
+      elapsed += (unsigned long)since * SPEED_STAGES /
+                 (SPEED_STAGES - _bomb_info.speed);
+  }
+  return elapsed < _bomb_info.duration ? _bomb_info.duration - elapsed : 0;
+}
+
+void timeStr(char *buffer, bool show_millis) {
+  formatTime(buffer, remainingTime(), show_millis);
+}
+
+// The last BombInfo received, with its time brought up to date.
+BombInfo currentBombInfo() {
+  BombInfo info = _bomb_info;
+  timeStr(info.time);
+  return info;
 }
 
-void withBombInfo(BombInfoCallback callback) {
-  int key = _bomb_info_key_index++;
-  _bomb_info_callbacks_map[key] = callback;
+void withBombInfo(BombInfoCallback callback, unsigned long timeout) {
+  if (bombInfoFresh()) {
+    callback(currentBombInfo());
+    return;
+  }
+  if (_bomb_info_waiters_count == BOMB_INFO_WAITERS) {
+    if (_has_bomb_info)
+      callback(currentBombInfo());
+    return;
+  }
+  _bomb_info_waiters[_bomb_info_waiters_count++] = {callback,
+                                                    Clock::millis() + timeout};
+  startTimer(_bomb_info_request_timer, 0);
+}
+
+// Waiters that run out of time get the last copy known, however old, or
+// nothing if no BOMB_INFO was ever received. They are taken off the list
+// before being called back, as the callbacks may wait again.
+void expireBombInfoWaiters(bool all) {
+  BombInfoWaiter expired[BOMB_INFO_WAITERS];
+  int expired_count = 0;
+  for (int i = 0; i < _bomb_info_waiters_count;) {
+    if (all || (long)(Clock::millis() - _bomb_info_waiters[i].deadline) >= 0) {
+      expired[expired_count++] = _bomb_info_waiters[i];
+      _bomb_info_waiters[i] = _bomb_info_waiters[--_bomb_info_waiters_count];
+      _bomb_info_waiters[_bomb_info_waiters_count].callback = nullptr;
+    } else {
+      i++;
+    }
+  }
+  if (DEBUG && expired_count > 0)
+    Serial.println("BombInfo request timed out");
+  if (!_has_bomb_info)
+    return;
+  BombInfo info = currentBombInfo();
+  for (int i = 0; i < expired_count; i++)
+    expired[i].callback(info);
+}
+
+// Sends the outstanding request, starting a new one if needed, and returns
+// how long until it should be sent again.
+unsigned long sendBombInfoRequest() {
+  if (_bomb_info_request_key == 0) {
+    if (++_bomb_info_key_index == 0)
+      _bomb_info_key_index++;
+    _bomb_info_request_key = _bomb_info_key_index;
+    _bomb_info_request_attempts = 0;
+  } else {
+    unsigned long waited = Clock::millis() - _bomb_info_request_sent_at;
+    if (waited < BOMB_INFO_RETRY_DELAY)
+      return BOMB_INFO_RETRY_DELAY - waited;
+  }
+  if (_bomb_info_request_attempts >= BOMB_INFO_MAX_ATTEMPTS) {
+    _bomb_info_request_key = 0;
+    expireBombInfoWaiters(true);
+    return BOMB_INFO_RETRY_DELAY;
+  }
+  BombInfoRequest request;
+  request.key = _bomb_info_request_key;
+  if (send(request, _main_module.peer_addr) != ESP_OK)
+    return SEND_RETRY_DELAY;
+  _bomb_info_request_attempts++;
+  _bomb_info_request_sent_at = Clock::millis();
+  return BOMB_INFO_RETRY_DELAY;
+}
+
+// Runs from its timer until every waiter is answered or expired.
+void updateBombInfoRequest() {
+  expireBombInfoWaiters(false);
+  unsigned long next = BOMB_INFO_RETRY_DELAY;
+  if (_connected && _bomb_info_waiters_count > 0)
+    next = sendBombInfoRequest();
+  if (_bomb_info_waiters_count == 0) {
+    _bomb_info_request_key = 0;
+    return;
+  }
+  unsigned long now = Clock::millis();
+  for (int i = 0; i < _bomb_info_waiters_count; i++) {
+    unsigned long deadline = _bomb_info_waiters[i].deadline;
+    next = min(next, (long)(deadline - now) > 0 ? deadline - now : 0);
+  }
+  startTimer(_bomb_info_request_timer, next);
+}
+
+void setAckSlots(int slots) {
+  if (slots > 0)
+    _ack_slots = slots;
+}
+
+void startRecv();
+
+void bombInfoRecv(const BombInfo &info, const uint8_t *mac) {
+  if (!_connected || memcmp(mac, _main_module.peer_addr, MAC_ADDRESS_SIZE) != 0)
+    return;
+  // Every BOMB_INFO is a full snapshot, so one arriving after a gap already
+  // carries everything that was missed; only reordered ones are dropped.
+  if (bombInfoFresh() && (int16_t)(info.sequence - _bomb_info.sequence) < 0) {
+    Stats::duplicate(BOMB_INFO, mac);
+    return;
+  }
+  if (info.request_key != 0 && info.request_key == _bomb_info_request_key &&
+      _bomb_info_request_attempts == 1)
+    Stats::roundTrip(Stats::BOMB_INFO_RTT,
+                     frameReceivedAt() - _bomb_info_request_sent_at);
+  _bomb_info = info;
+  _has_bomb_info = true;
+  setAckSlots(info.ack_slots);
+  _bomb_info_received_at = Clock::millis();
+  if (info.code != _code) {
+    _code = info.code;
+    if (onManualCode != nullptr)
+      onManualCode(_code);
+  }
+  // Catch-up for modules that missed START or joined after it.
+  if (info.running && !_started)
+    startRecv();
+
+  // Only the reply to the outstanding request or a push answers the waiters.
+  // A late reply to an earlier request still updates the copy above, but it
+  // may predate some of them.
+  if (info.request_key != 0 && info.request_key != _bomb_info_request_key)
+    return;
+  _bomb_info_request_key = 0;
+  BombInfoWaiter waiters[BOMB_INFO_WAITERS];
+  int waiters_count = _bomb_info_waiters_count;
+  for (int i = 0; i < waiters_count; i++) {
+    waiters[i] = _bomb_info_waiters[i];
+    _bomb_info_waiters[i].callback = nullptr;
+  }
+  _bomb_info_waiters_count = 0;
+  BombInfo current = currentBombInfo();
+  for (int i = 0; i < waiters_count; i++)
+    waiters[i].callback(current);
 }
 
-void bombInfoRecv(BombInfo info) {
-  for (auto _bomb_info_callback : _bomb_info_callbacks_map) {
-    _bomb_info_callback.second(info);
-    _bomb_info_callbacks_map.erase(_bomb_info_callback.first);
+void syncClock() {
+  if (!_connected)
+    return;
+  TimeSyncRequest request;
+  request.origin = Clock::millis();
+  if (send(request, _main_module.peer_addr) != ESP_OK) {
+    startTimer(_clock_sync_timer, SEND_RETRY_DELAY);
+    return;
   }
+  startTimer(_clock_sync_timer,
+             _clock.settled() ? CLOCK_SYNC_INTERVAL : CLOCK_SYNC_FAST_INTERVAL);
+}
+
+void timeSyncRecv(TimeSyncView sync, const uint8_t *mac) {
+  if (!_connected || memcmp(mac, _main_module.peer_addr, MAC_ADDRESS_SIZE) != 0)
+    return;
+  _clock.sample(sync.get<TimeSyncWire::Origin>(),
+                sync.get<TimeSyncWire::Receive>(),
+                sync.get<TimeSyncWire::Transmit>(), frameReceivedAt());
 }
 
 Status status() {
@@ -76,89 +407,233 @@ Status status() {
   return Status::Solved;
 }
 
-void connectionInfoRecv(Connection info, const uint8_t *mac) {
-  if (!_connected && tryConnectingToPeer(mac, &_main_module)) {
-    if (DEBUG)
-      Serial.println("Connected to main module");
-    _connected = true;
+void announce() {
+  Announce info;
+  info.type = _type;
+  info.connected = _connected;
+  info.boot = _boot;
+  if (_connected) {
+    send(info, _main_module.peer_addr);
+    return;
   }
+  // Only the first try goes to the remembered main module, which may be gone.
+  const uint8_t *mac = _main_module_added && _announce_delay == 0
+                           ? _main_module.peer_addr
+                           : _broadcast.peer_addr;
+  if (send(info, mac) != ESP_OK) {
+    startTimer(_announce_timer, SEND_RETRY_DELAY);
+    return;
+  }
+  _announce_delay = _announce_delay == 0
+                        ? ANNOUNCE_MIN_DELAY
+                        : min(2 * _announce_delay, ANNOUNCE_MAX_DELAY);
+  startTimer(_announce_timer, jitter(_announce_delay));
+}
+
+void rememberMainModule(const uint8_t *mac) {
+  uint8_t remembered[MAC_ADDRESS_SIZE];
+  _peers.begin(PEERS_NAMESPACE, false);
+  if (_peers.getBytes(MAIN_MODULE_KEY, remembered, MAC_ADDRESS_SIZE) !=
+          MAC_ADDRESS_SIZE ||
+      memcmp(remembered, mac, MAC_ADDRESS_SIZE) != 0)
+    _peers.putBytes(MAIN_MODULE_KEY, mac, MAC_ADDRESS_SIZE);
+  _peers.end();
+}
+
+void loadMainModule() {
+  uint8_t mac[MAC_ADDRESS_SIZE];
+  _peers.begin(PEERS_NAMESPACE, true);
+  size_t len = _peers.getBytes(MAIN_MODULE_KEY, mac, MAC_ADDRESS_SIZE);
+  _peers.end();
+  if (len == MAC_ADDRESS_SIZE)
+    _main_module_added = tryConnectingToPeer(mac, &_main_module);
+}
+
+// Starts the work that waited for the main module.
+void connected() {
+  _connected = true;
+  startTimer(_clock_sync_timer, 0);
+  startTimer(_bomb_info_request_timer, 0);
+  startTimer(_solve_attempt_timer, 0);
+}
+
+void connectionInfoRecv(ConnectionView info, const uint8_t *mac) {
+  if (_connected)
+    return;
+  if (!_main_module_added ||
+      memcmp(mac, _main_module.peer_addr, MAC_ADDRESS_SIZE) != 0) {
+    if (_main_module_added)
+      removePeer(_main_module.peer_addr);
+    _main_module_added = tryConnectingToPeer(mac, &_main_module);
+    if (!_main_module_added)
+      return;
+  }
+  if (DEBUG)
+    Serial.println("Connected to main module");
+  setEpoch(_frame_epoch);
+  setAckSlots(info.get<ConnectionWire::AckSlots>());
+  rememberMainModule(mac);
+  connected();
+  // Beacons do not tell the main module about this one, so it is told now
+  // instead of at the next HEARTBEAT. Every module hears the same beacon, the
+  // answers are spread out so they do not collide.
+  startTimer(_announce_timer, esp_random() % ANNOUNCE_MIN_DELAY);
+}
+
+void queueAck(bool &pending) {
+  pending = true;
+  if (!_ack_timer.running())
+    startTimer(_ack_timer, ackDelay(_ack_slots));
+}
+
+void sendAcks() {
+  if (_heartbeat_ack_pending) {
+    HeartbeatAck ack;
+    ack.type = _type;
+    if (send(ack, _heartbeat_mac) != ESP_OK) {
+      startTimer(_ack_timer, SEND_RETRY_DELAY);
+      return;
+    }
+    _heartbeat_ack_pending = false;
+  }
+  if (_start_ack_pending) {
+    if (send(START_ACK, _main_module.peer_addr) != ESP_OK) {
+      startTimer(_ack_timer, SEND_RETRY_DELAY);
+      return;
+    }
+    _start_ack_pending = false;
+  }
+  if (_reset_ack_pending) {
+    if (send(RESET_ACK, _main_module.peer_addr) != ESP_OK) {
+      startTimer(_ack_timer, SEND_RETRY_DELAY);
+      return;
+    }
+    _reset_ack_pending = false;
+  }
+}
+
+// Modules not connected yet answer too, so the main module finds them.
+void heartbeatRecv(const uint8_t *mac) {
+  memcpy(_heartbeat_mac, mac, MAC_ADDRESS_SIZE);
+  queueAck(_heartbeat_ack_pending);
 }
 
 void startRecv() {
   if (_code == -1)
     return;
+  if (_started)
+    Stats::duplicate(START, _main_module.peer_addr);
   if (!_started && onStart != nullptr) {
     if (DEBUG)
       Serial.println("Starting module");
     onStart();
   }
   _started = true;
-  send(START_ACK, _main_module.peer_addr);
+  queueAck(_start_ack_pending);
 }
 
 void initialize() {
   _code = -1;
   _connected = _started = _solved = false;
-  _pending_solve_attempts.clear();
-  _bomb_info_callbacks_map.clear();
+  _has_bomb_info = false;
+  _queued_solve_attempts.clear();
+  _outstanding_solve_attempts_count = 0;
+  for (int i = 0; i < _bomb_info_waiters_count; i++)
+    _bomb_info_waiters[i].callback = nullptr;
+  _bomb_info_waiters_count = 0;
+  _bomb_info_request_key = 0;
+  stopTimer(_clock_sync_timer);
+  stopTimer(_bomb_info_request_timer);
+  stopTimer(_solve_attempt_timer);
+  stopTimer(_announce_timer);
+  _heartbeat_ack_pending = _start_ack_pending = _reset_ack_pending = false;
+  stopTimer(_ack_timer);
 }
 
-void resetRecv() {
+// A frame of the main module with another epoch means it moved to another
+// game, through a RESET or one this module missed, or restarted; its messages
+// already belong to the new game. Stale frames were reordered and are dropped.
+// Until connected, the epoch is only taken from the main module remembered
+// from before, so that the answers to it carry it, and from the CONNECTION
+// that connects the module. Other modules announcing themselves carry epochs
+// of their own, and following them would drop this module's ANNOUNCE.
+bool frameRecv(const uint8_t *mac, uint16_t frame_epoch) {
+  _frame_epoch = frame_epoch;
+  if (!_connected) {
+    if (_main_module_added &&
+        memcmp(mac, _main_module.peer_addr, MAC_ADDRESS_SIZE) == 0)
+      setEpoch(frame_epoch);
+    return true;
+  }
+  if (memcmp(mac, _main_module.peer_addr, MAC_ADDRESS_SIZE) != 0 ||
+      frame_epoch == epoch())
+    return true;
+  if (staleEpoch(frame_epoch))
+    return false;
+  setEpoch(frame_epoch);
   initialize();
-  _connected = true;
+  connected();
   if (onRestart != nullptr)
     onRestart();
-  send(RESET_ACK, _main_module.peer_addr);
+  return true;
 }
 
-void updateManualCode() {
-  if (onManualCode != nullptr &&
-      millis() - _last_bomb_info_request > BOMB_INFO_DELAY) {
-    _last_bomb_info_request = millis();
-    withBombInfo([](BombInfo info) {
-      if (info.code != _code) {
-        _code = info.code;
-        onManualCode(_code);
-      }
-    });
-  }
-}
+// The restart happened when the new epoch arrived; repeated RESETs are only
+// acked again.
+void resetRecv() { queueAck(_reset_ack_pending); }
+
+void setName(const char *module_name) { name = module_name; }
 
 void solve() { _solved = true; }
 
 void update() {
   OTA::update();
-
-  _update_manual_code_debouncer(updateManualCode);
-  if (!_bomb_info_callbacks_map.empty())
-    _bomb_info_debouncer([&]() {
-      BombInfoRequest info;
-      info.key = 0;
-      send(info, _main_module.peer_addr);
-    });
-  _solve_attempt_debouncer([&]() { sendPendingSolveAttempts(); });
+  updateProtocol();
+  flushMessages();
 }
 
+struct ModuleHandlers : Handlers {
+  static void onBombInfo(const BombInfo &info, const uint8_t *mac) {
+    bombInfoRecv(info, mac);
+  }
+  static void onConnection(ConnectionView info, const uint8_t *mac) {
+    connectionInfoRecv(info, mac);
+  }
+  static void onSolveAttemptAck(SolveAttemptAckView ack) {
+    solveAttemptAckRecv(ack);
+  }
+  static void onTimeSync(TimeSyncView sync, const uint8_t *mac) {
+    timeSyncRecv(sync, mac);
+  }
+  static bool onFrame(const uint8_t *mac, uint16_t frame_epoch) {
+    return frameRecv(mac, frame_epoch);
+  }
+  static void onFrameSent(const uint8_t *mac, bool delivered) {
+    frameSentRecv(mac, delivered);
+  }
+  static void onHeartbeat(const uint8_t *mac) { heartbeatRecv(mac); }
+  static void onStart() { startRecv(); }
+  static void onReset() { resetRecv(); }
+};
+
 bool setup(ModuleType type) {
   initialize();
 
   _type = type;
+  _boot = esp_random();
 
-  Callbacks callbacks;
-  callbacks.bombInfoCallback = bombInfoRecv;
-  callbacks.connectionCallback = connectionInfoRecv;
-  callbacks.solveAttemptAckCallback = solveAttemptAckRecv;
-  callbacks.startCallback = startRecv;
-  callbacks.resetCallback = resetRecv;
-
-  if (!initProtocol(name, callbacks, _type))
+  if (!initProtocol<ModuleHandlers>(name, _type))
     return false;
 
   if (OTA::running())
     return true;
 
-  _mac_address = WiFi.macAddress();
-
+  if (!tryConnectingToPeer(BROADCAST_ADDRESS, &_broadcast))
+    return false;
+  loadMainModule();
+  _announce_delay = 0;
+  startTimer(_announce_timer,
+             _main_module_added ? 0 : jitter(ANNOUNCE_MIN_DELAY));
   return true;
 }
 } // namespace Module
\ No newline at end of file
@@ -6,20 +6,33 @@
 namespace Module {
 enum class Status { Connecting, Connected, Started, Solved, OTA };
 
-using OnRestart = std::function<void()>;
-using OnStart = std::function<void()>;
-using OnManualCode = std::function<void(int)>;
+using OnRestart = Callback<void(), CALLBACK_SIZE>;
+using OnStart = Callback<void(), CALLBACK_SIZE>;
+using OnManualCode = Callback<void(int), CALLBACK_SIZE>;
 
-extern String name;
-extern OnRestart onRestart;
-extern OnStart onStart;
-extern OnManualCode onManualCode;
+// Must outlive the module, a string literal usually.
+extern NODE_LOCAL const char *name;
+extern NODE_LOCAL OnRestart onRestart;
+extern NODE_LOCAL OnStart onStart;
+extern NODE_LOCAL OnManualCode onManualCode;
 
-void setName(String name);
+void setName(const char *module_name);
 bool setup(ModuleType type);
-void withBombInfo(BombInfoCallback callback);
-void queueSolveAttempt(SolveAttempt attempt);
+const unsigned long BOMB_INFO_TIMEOUT = 250;
+
+// Calls back with the latest BombInfo, right away while the last one pushed is
+// fresh. Once BOMB_INFO_WAITERS callers wait, more get the last one known, if
+// any, as if they had timed out.
+void withBombInfo(BombInfoCallback callback,
+                  unsigned long timeout = BOMB_INFO_TIMEOUT);
+// Returns false when SOLVE_ATTEMPT_QUEUE_SIZE attempts wait already.
+bool queueSolveAttempt(SolveAttempt attempt);
 Status status();
+// Countdown of the bomb, drawn from the last BombInfo and the main module's
+// clock without asking it.
+unsigned long remainingTime();
+// Format into a buffer of at least TIME_LENGTH + 1 chars.
+void timeStr(char *buffer, bool show_millis = true);
 void update();
 void solve();
 }; // namespace Module
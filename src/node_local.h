@@ -0,0 +1,10 @@
+#ifndef NODE_LOCAL_H
+#define NODE_LOCAL_H
+
+// Storage class for per-device state. Host builds simulate many devices in one
+// process, one thread each, and define this as thread_local.
+#ifndef NODE_LOCAL
+#define NODE_LOCAL
+#endif
+
+#endif // NODE_LOCAL_H
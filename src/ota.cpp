@@ -3,6 +3,7 @@
 #include <Preferences.h>
 #include <Update.h>
 #include <WiFi.h>
+#include <clock.h>
 #include <esp_now.h>
 #include <ota.h>
 
@@ -32,6 +33,7 @@ void start(String version, String name) {
   if (ssid.length() > 0) {
     WiFi.begin(ssid.c_str(), password.c_str());
 
+    // Blocks on the board's clock: Wi-Fi connects in real time.
     unsigned long startAttemptTime = millis();
     while (WiFi.status() != WL_CONNECTED &&
            millis() - startAttemptTime < WIFI_WAIT) {
@@ -171,7 +173,7 @@ bool shouldStart() {
 void update() {
   if (!_could_be_power_cycle)
     return;
-  if (millis() > POWER_CYCLE_TIME_THRESHOLD) {
+  if (Clock::millis() > POWER_CYCLE_TIME_THRESHOLD) {
     reset();
     _could_be_power_cycle = false;
   }
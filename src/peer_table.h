@@ -0,0 +1,123 @@
+#ifndef PEER_TABLE_H
+#define PEER_TABLE_H
+
+#include <stdint.h>
+#include <string.h>
+
+// The 48 bits of a MAC address packed into a uint64_t.
+inline uint64_t macKey(const uint8_t *mac) {
+  uint64_t key = 0;
+  for (int i = 0; i < 6; i++)
+    key = (key << 8) | mac[i];
+  return key;
+}
+
+// Fibonacci hash of a MAC address; its high bits are the well mixed ones.
+inline uint64_t macHash(const uint8_t *mac) {
+  return macKey(mac) * 0x9E3779B97F4A7C15ull;
+}
+
+constexpr int peerTableSlots(int n, int slots = 1) {
+  return slots >= 2 * n ? slots : peerTableSlots(n, slots * 2);
+}
+
+// Maps up to N MAC addresses to dense indexes 0..size()-1, so per-peer state
+// can live in plain arrays and bitsets. Lookups hash the 48-bit MAC packed in
+// a uint64_t into an open-addressed table twice as large as N.
+template <int N> class PeerTable {
+public:
+  static const int NONE = -1;
+
+  PeerTable() { clear(); }
+
+  void clear() {
+    _size = 0;
+    for (int i = 0; i < SLOTS; i++)
+      _slots[i] = NONE;
+  }
+
+  int size() const { return _size; }
+  bool full() const { return _size == N; }
+  const uint8_t *mac(int index) const { return _macs[index]; }
+
+  int find(const uint8_t *mac) const {
+    uint64_t key = macKey(mac);
+    for (int slot = home(key);; slot = (slot + 1) & (SLOTS - 1)) {
+      int index = _slots[slot];
+      if (index == NONE || _keys[index] == key)
+        return index;
+    }
+  }
+
+  // Returns the index of `mac`, adding it if needed, or NONE when full.
+  int add(const uint8_t *mac) {
+    uint64_t key = macKey(mac);
+    int slot = home(key);
+    for (; _slots[slot] != NONE; slot = (slot + 1) & (SLOTS - 1))
+      if (_keys[_slots[slot]] == key)
+        return _slots[slot];
+    if (full())
+      return NONE;
+    _slots[slot] = _size;
+    _keys[_size] = key;
+    memcpy(_macs[_size], mac, 6);
+    return _size++;
+  }
+
+  // Removes `mac`; the last peer takes over its index.
+  bool remove(const uint8_t *mac) {
+    int slot = slotOf(macKey(mac));
+    if (slot == NONE)
+      return false;
+    int index = _slots[slot];
+    erase(slot);
+    int last = --_size;
+    if (index != last) {
+      _slots[slotOf(_keys[last])] = index;
+      _keys[index] = _keys[last];
+      memcpy(_macs[index], _macs[last], 6);
+    }
+    return true;
+  }
+
+private:
+  static const int SLOTS = peerTableSlots(N);
+
+  static int home(uint64_t key) {
+    return (key * 0x9E3779B97F4A7C15ull) >> 40 & (SLOTS - 1);
+  }
+
+  int slotOf(uint64_t key) const {
+    for (int slot = home(key);; slot = (slot + 1) & (SLOTS - 1)) {
+      if (_slots[slot] == NONE)
+        return NONE;
+      if (_keys[_slots[slot]] == key)
+        return slot;
+    }
+  }
+
+  // Backward-shift deletion keeps every probe chain contiguous.
+  void erase(int slot) {
+    int next = slot;
+    while (true) {
+      next = (next + 1) & (SLOTS - 1);
+      if (_slots[next] == NONE)
+        break;
+      int wanted = home(_keys[_slots[next]]);
+      bool movable = slot <= next ? (wanted <= slot || wanted > next)
+                                  : (wanted <= slot && wanted > next);
+      if (movable) {
+        _slots[slot] = _slots[next];
+        slot = next;
+      }
+    }
+    _slots[slot] = NONE;
+  }
+
+  int _size;
+  int16_t _slots[SLOTS];
+  uint64_t _keys[N];
+  uint8_t _macs[N][6];
+};
+
+#endif // PEER_TABLE_H
@@ -1,21 +1,17 @@
-#include <map>
-#include <set>
-
 #include <puzzle_module.h>
-#include <utils/debouncer.h>
 
 namespace PuzzleModule {
 const int STATUS_LIGHT_STRIKE_DURATION = 1000;
 const int STATUS_LIGHT_STRIKE_BLINK_DURATION = 1000;
 const int STATUS_LIGHT_CONNECTING_BLINK_DURATION = 1000;
 const int STATUS_LIGHT_OTA_BLINK_DURATION = 500;
-unsigned long _last_strike;
+NODE_LOCAL unsigned long _last_strike;
 
-StatusLight statusLight;
+NODE_LOCAL StatusLight statusLight;
 
 void strike() {
   statusLight.strike();
-  _last_strike = millis();
+  _last_strike = Clock::millis();
   SolveAttempt attempt;
   attempt.fail = false;
   attempt.strike = true;
@@ -30,7 +26,7 @@ void solve() {
 }
 
 void updateStatusLight() {
-  if (millis() - _last_strike < STATUS_LIGHT_STRIKE_BLINK_DURATION)
+  if (Clock::millis() - _last_strike < STATUS_LIGHT_STRIKE_BLINK_DURATION)
     return;
   statusLight.update(Module::status());
 }
@@ -62,7 +58,7 @@ void StatusLight::setPin(int pin, bool state) {
 
 void StatusLight::update(Module::Status status) {
   if (status == Module::Status::Connecting) {
-    bool state = (millis() / STATUS_LIGHT_CONNECTING_BLINK_DURATION) % 2;
+    bool state = (Clock::millis() / STATUS_LIGHT_CONNECTING_BLINK_DURATION) % 2;
     setPin(_redPin, state);
     setPin(_greenPin, state);
   } else if (status == Module::Status::Connected) {
@@ -75,7 +71,7 @@ void StatusLight::update(Module::Status status) {
     setPin(_redPin, LOW);
     setPin(_greenPin, HIGH);
   } else if (status == Module::Status::OTA) {
-    bool state = (millis() / STATUS_LIGHT_OTA_BLINK_DURATION) % 2;
+    bool state = (Clock::millis() / STATUS_LIGHT_OTA_BLINK_DURATION) % 2;
     setPin(_redPin, LOW);
     setPin(_greenPin, state);
   }
@@ -27,7 +27,7 @@ enum class LightStatus {
   Yellow,
 };
 
-extern StatusLight statusLight;
+extern NODE_LOCAL StatusLight statusLight;
 
 void solve();
 void strike();
@@ -0,0 +1,136 @@
+#include <bomb_protocol.h>
+#include <peer_table.h>
+#include <stats.h>
+
+namespace Stats {
+const char *const MESSAGE_NAMES[MESSAGE_TYPES] = {
+    "UNKNOWN",
+    "CONNECTION",
+    "BOMB_INFO",
+    "BOMB_INFO_REQUEST",
+    "SOLVE_ATTEMPT",
+    "SOLVE_ATTEMPT_ACK",
+    "START",
+    "START_ACK",
+    "RESET",
+    "RESET_ACK",
+    "HEARTBEAT",
+    "HEARTBEAT_ACK",
+    "TIME_SYNC_REQUEST",
+    "TIME_SYNC",
+    "ANNOUNCE",
+};
+const char *const RTT_NAMES[RTT_PAIRS] = {"SOLVE_ATTEMPT", "BOMB_INFO", "START",
+                                          "HEARTBEAT", "RESET"};
+
+NODE_LOCAL Counters _messages[MESSAGE_TYPES];
+NODE_LOCAL PeerTable<MAX_PEERS> _peers;
+NODE_LOCAL Counters _peer_counters[MAX_PEERS];
+NODE_LOCAL RttHistogram _rtts[RTT_PAIRS];
+
+// Counters of `mac`, or nullptr once every slot is taken by other peers.
+Counters *peerCounters(const uint8_t *mac) {
+  int index = _peers.find(mac);
+  if (index == PeerTable<MAX_PEERS>::NONE) {
+    index = _peers.add(mac);
+    if (index == PeerTable<MAX_PEERS>::NONE)
+      return nullptr;
+    _peer_counters[index] = Counters();
+  }
+  return &_peer_counters[index];
+}
+
+void sent(MessageType type, const uint8_t *mac) {
+  _messages[type].tx++;
+  if (Counters *counters = peerCounters(mac))
+    counters->tx++;
+}
+
+void sendFailed(MessageType type, const uint8_t *mac) {
+  _messages[type].send_errors++;
+  if (Counters *counters = peerCounters(mac))
+    counters->send_errors++;
+}
+
+void undelivered(MessageType type, const uint8_t *mac) {
+  _messages[type].undelivered++;
+  if (Counters *counters = peerCounters(mac))
+    counters->undelivered++;
+}
+
+void received(MessageType type, const uint8_t *mac) {
+  _messages[type].rx++;
+  if (Counters *counters = peerCounters(mac))
+    counters->rx++;
+}
+
+void duplicate(MessageType type, const uint8_t *mac) {
+  _messages[type].duplicates++;
+  if (Counters *counters = peerCounters(mac))
+    counters->duplicates++;
+}
+
+void roundTrip(RttPair pair, unsigned long rtt) {
+  RttHistogram &histogram = _rtts[pair];
+  if (histogram.count == 0 || rtt < histogram.min)
+    histogram.min = rtt;
+  if (rtt > histogram.max)
+    histogram.max = rtt;
+  histogram.count++;
+  int bucket = 0;
+  while (rtt > 0 && bucket < RTT_BUCKETS - 1) {
+    rtt >>= 1;
+    bucket++;
+  }
+  histogram.buckets[bucket]++;
+}
+
+const Counters &message(MessageType type) { return _messages[type]; }
+
+int peers() { return _peers.size(); }
+
+const uint8_t *peerMac(int index) { return _peers.mac(index); }
+
+const Counters &peer(int index) { return _peer_counters[index]; }
+
+const RttHistogram &rtt(RttPair pair) { return _rtts[pair]; }
+
+void clear() {
+  for (int i = 0; i < MESSAGE_TYPES; i++)
+    _messages[i] = Counters();
+  _peers.clear();
+  for (int i = 0; i < RTT_PAIRS; i++)
+    _rtts[i] = RttHistogram();
+}
+
+void dumpCounters(const Counters &counters) {
+  Serial.printf(",%lu,%lu,%lu,%lu,%lu\n", (unsigned long)counters.tx,
+                (unsigned long)counters.rx, (unsigned long)counters.send_errors,
+                (unsigned long)counters.undelivered,
+                (unsigned long)counters.duplicates);
+}
+
+void dump() {
+  Serial.printf("stats,%lu\n", Clock::millis());
+  for (int i = 1; i < MESSAGE_TYPES; i++) {
+    Serial.printf("message,%s", MESSAGE_NAMES[i]);
+    dumpCounters(_messages[i]);
+  }
+  for (int i = 0; i < _peers.size(); i++) {
+    const uint8_t *mac = _peers.mac(i);
+    Serial.printf("peer,%02x:%02x:%02x:%02x:%02x:%02x", mac[0], mac[1], mac[2],
+                  mac[3], mac[4], mac[5]);
+    dumpCounters(_peer_counters[i]);
+  }
+  for (int i = 0; i < RTT_PAIRS; i++) {
+    const RttHistogram &histogram = _rtts[i];
+    Serial.printf("rtt,%s,%lu,%lu,%lu", RTT_NAMES[i],
+                  (unsigned long)histogram.count, (unsigned long)histogram.min,
+                  (unsigned long)histogram.max);
+    for (int j = 0; j < RTT_BUCKETS; j++)
+      Serial.printf(",%lu", (unsigned long)histogram.buckets[j]);
+    Serial.printf("\n");
+  }
+  Serial.printf("end\n");
+}
+} // namespace Stats
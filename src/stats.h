@@ -0,0 +1,53 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <messages.h>
+
+// Traffic counters kept by the protocol, per message type and per peer, and
+// round trip histograms of the request/answer pairs. Counts are in messages:
+// every message of a frame the transport refused is a send error, and every
+// message of a unicast frame that was not acked is undelivered.
+namespace Stats {
+// Bucket 0 holds round trips under 1 ms, bucket i those in [2^(i-1), 2^i) ms
+// and the last one everything longer.
+const int RTT_BUCKETS = 12;
+
+enum RttPair {
+  SOLVE_ATTEMPT_RTT, // SOLVE_ATTEMPT -> SOLVE_ATTEMPT_ACK
+  BOMB_INFO_RTT,     // BOMB_INFO_REQUEST -> BOMB_INFO
+  START_RTT,         // START -> START_ACK
+  HEARTBEAT_RTT,     // HEARTBEAT -> HEARTBEAT_ACK
+  RESET_RTT,         // RESET -> RESET_ACK
+  RTT_PAIRS,
+};
+
+struct Counters {
+  uint32_t tx, rx, send_errors, undelivered, duplicates;
+};
+
+struct RttHistogram {
+  uint32_t count, min, max;
+  uint32_t buckets[RTT_BUCKETS];
+};
+
+void sent(MessageType type, const uint8_t *mac);
+void sendFailed(MessageType type, const uint8_t *mac);
+void undelivered(MessageType type, const uint8_t *mac);
+void received(MessageType type, const uint8_t *mac);
+void duplicate(MessageType type, const uint8_t *mac);
+void roundTrip(RttPair pair, unsigned long rtt);
+
+const Counters &message(MessageType type);
+// Peers are numbered in the order they were first seen, up to MAX_PEERS.
+int peers();
+const uint8_t *peerMac(int index);
+const Counters &peer(int index);
+const RttHistogram &rtt(RttPair pair);
+void clear();
+
+// Writes everything to Serial as one CSV block between "stats,<millis>" and
+// "end" lines.
+void dump();
+} // namespace Stats
+
+#endif // STATS_H
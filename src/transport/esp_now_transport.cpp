@@ -0,0 +1,42 @@
+#include <WiFi.h>
+#include <esp_now.h>
+#include <node_local.h>
+#include <transport/esp_now_transport.h>
+
+namespace {
+NODE_LOCAL TransportSent _sent = nullptr;
+
+void onDataSent(const uint8_t *mac, esp_now_send_status_t status) {
+  if (_sent != nullptr)
+    _sent(mac, status == ESP_NOW_SEND_SUCCESS);
+}
+} // namespace
+
+bool EspNowTransport::begin(TransportRecv recv, TransportSent sent) {
+  WiFi.mode(WIFI_STA);
+  if (esp_now_init() != ESP_OK)
+    return false;
+  _sent = sent;
+  return esp_now_register_recv_cb(recv) == ESP_OK &&
+         esp_now_register_send_cb(onDataSent) == ESP_OK;
+}
+
+bool EspNowTransport::addPeer(const uint8_t *mac) {
+  esp_now_peer_info_t peer = {};
+  memcpy(peer.peer_addr, mac, ESP_NOW_ETH_ALEN);
+  peer.channel = 0;
+  peer.encrypt = false;
+  return esp_now_add_peer(&peer) == ESP_OK;
+}
+
+bool EspNowTransport::removePeer(const uint8_t *mac) {
+  return esp_now_del_peer(mac) == ESP_OK;
+}
+
+void EspNowTransport::macAddress(uint8_t *mac) { WiFi.macAddress(mac); }
+
+esp_err_t EspNowTransport::send(const uint8_t *mac, const uint8_t *data,
+                                size_t len) {
+  esp_err_t result = esp_now_send(mac, data, len);
+  return result == ESP_ERR_ESPNOW_NO_MEM ? ESP_ERR_NO_MEM : result;
+}
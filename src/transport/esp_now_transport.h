@@ -0,0 +1,15 @@
+#ifndef ESP_NOW_TRANSPORT_H
+#define ESP_NOW_TRANSPORT_H
+
+#include <transport/transport.h>
+
+class EspNowTransport : public Transport {
+public:
+  bool begin(TransportRecv recv, TransportSent sent) override;
+  bool addPeer(const uint8_t *mac) override;
+  bool removePeer(const uint8_t *mac) override;
+  void macAddress(uint8_t *mac) override;
+  esp_err_t send(const uint8_t *mac, const uint8_t *data, size_t len) override;
+};
+
+#endif // ESP_NOW_TRANSPORT_H
@@ -0,0 +1,37 @@
+#ifndef TRANSPORT_H
+#define TRANSPORT_H
+
+#include <Arduino.h>
+
+const int MAC_ADDRESS_SIZE = 6;
+const uint8_t BROADCAST_ADDRESS[MAC_ADDRESS_SIZE] = {0xff, 0xff, 0xff,
+                                                     0xff, 0xff, 0xff};
+// Every transport carries frames of up to MAX_FRAME_SIZE bytes, the most
+// ESP-NOW takes.
+const int MAX_FRAME_SIZE = 250;
+
+using TransportRecv = void (*)(const uint8_t *mac, const uint8_t *data,
+                               int len);
+// Reports, once per frame accepted by send() and in the same order, whether
+// it reached `mac`: acked at the MAC layer for unicast, sent for broadcast.
+using TransportSent = void (*)(const uint8_t *mac, bool delivered);
+
+// Moves protocol frames between modules. Addresses are 6-byte MACs and
+// FF:FF:FF:FF:FF:FF is broadcast, as with ESP-NOW.
+class Transport {
+public:
+  virtual ~Transport() {}
+  virtual bool begin(TransportRecv recv, TransportSent sent) = 0;
+  virtual bool addPeer(const uint8_t *mac) = 0;
+  virtual bool removePeer(const uint8_t *mac) = 0;
+  virtual void macAddress(uint8_t *mac) = 0;
+  // Returns ESP_ERR_NO_MEM when the transport has no buffer left for now; the
+  // frame may be sent again once earlier ones completed.
+  virtual esp_err_t send(const uint8_t *mac, const uint8_t *data,
+                         size_t len) = 0;
+  // Called from the protocol update for transports that have no receive task
+  // of their own.
+  virtual void poll() {}
+};
+
+#endif // TRANSPORT_H
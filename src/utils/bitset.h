@@ -0,0 +1,59 @@
+#ifndef BITSET_H
+#define BITSET_H
+
+#include <stdint.h>
+
+// Fixed-size set of bits indexed from 0 to N - 1.
+template <int N> class Bitset {
+public:
+  Bitset() { clear(); }
+
+  void clear() {
+    for (int i = 0; i < WORDS; i++)
+      _words[i] = 0;
+  }
+
+  void set(int index) { _words[index / 32] |= 1u << (index % 32); }
+  void reset(int index) { _words[index / 32] &= ~(1u << (index % 32)); }
+  bool test(int index) const {
+    return (_words[index / 32] >> (index % 32)) & 1;
+  }
+
+  // First bit set at or after `from`, wrapping around past N - 1, or -1 if
+  // none is.
+  int next(int from) const {
+    int first = from / 32;
+    for (int i = 0; i <= WORDS; i++) {
+      int word = (first + i) % WORDS;
+      uint32_t bits = _words[word];
+      if (i == 0)
+        bits &= ~0u << (from % 32);
+      else if (i == WORDS)
+        bits &= ~(~0u << (from % 32));
+      if (bits != 0)
+        return word * 32 + __builtin_ctz(bits);
+    }
+    return -1;
+  }
+
+  int count() const {
+    int total = 0;
+    for (int i = 0; i < WORDS; i++)
+      total += __builtin_popcount(_words[i]);
+    return total;
+  }
+
+  // Whether every bit set in `other` is also set here.
+  bool contains(const Bitset &other) const {
+    for (int i = 0; i < WORDS; i++)
+      if ((other._words[i] & ~_words[i]) != 0)
+        return false;
+    return true;
+  }
+
+private:
+  static const int WORDS = (N + 31) / 32;
+  uint32_t _words[WORDS];
+};
+
+#endif // BITSET_H
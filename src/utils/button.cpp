@@ -1,4 +1,5 @@
 #include <Arduino.h>
+#include <clock.h>
 #include <utils/button.h>
 
 const int DEBOUNCE_TIME = 50;
@@ -7,10 +8,10 @@ const int HOLD_TIME = 1000;
 void Button::update() {
   bool pressed = digitalRead(_pin);
   if (pressed != _last_pressed)
-    _last_debounce_time = millis();
-  if (millis() - _last_debounce_time > DEBOUNCE_TIME) {
+    _last_debounce_time = Clock::millis();
+  if (Clock::millis() - _last_debounce_time > DEBOUNCE_TIME) {
     ButtonState nextState = pressed ? Pressed : Released;
-    if (pressed && millis() - _last_debounce_time > HOLD_TIME)
+    if (pressed && Clock::millis() - _last_debounce_time > HOLD_TIME)
       nextState = Held;
     if (nextState != _state) {
       ButtonState last_state = _state;
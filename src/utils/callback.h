@@ -0,0 +1,102 @@
+#ifndef CALLBACK_H
+#define CALLBACK_H
+
+#include <new>
+#include <stddef.h>
+#include <type_traits>
+#include <utility>
+
+template <typename Signature, size_t SIZE> class Callback;
+
+// Callable holder like std::function that keeps the callable in place: one
+// larger than SIZE bytes does not compile instead of going to the heap, so
+// building, copying and calling a Callback never allocates.
+template <typename R, typename... Args, size_t SIZE>
+class Callback<R(Args...), SIZE> {
+public:
+  Callback() : _ops(nullptr) {}
+  Callback(std::nullptr_t) : _ops(nullptr) {}
+
+  template <typename F,
+            typename = typename std::enable_if<!std::is_same<
+                typename std::decay<F>::type, Callback>::value>::type>
+  Callback(F &&f) {
+    typedef typename std::decay<F>::type Callable;
+    static_assert(sizeof(Callable) <= SIZE,
+                  "callable does not fit in the Callback");
+    static_assert(alignof(Callable) <= alignof(Storage),
+                  "callable is aligned more strictly than the Callback");
+    new (&_storage) Callable(std::forward<F>(f));
+    _ops = &Ops<Callable>::OPS;
+  }
+
+  Callback(const Callback &other) : _ops(other._ops) {
+    if (_ops != nullptr)
+      _ops->copy(&_storage, &other._storage);
+  }
+
+  Callback &operator=(const Callback &other) {
+    if (this != &other) {
+      reset();
+      _ops = other._ops;
+      if (_ops != nullptr)
+        _ops->copy(&_storage, &other._storage);
+    }
+    return *this;
+  }
+
+  Callback &operator=(std::nullptr_t) {
+    reset();
+    return *this;
+  }
+
+  ~Callback() { reset(); }
+
+  R operator()(Args... args) const {
+    return _ops->invoke(&_storage, std::forward<Args>(args)...);
+  }
+
+  explicit operator bool() const { return _ops != nullptr; }
+  bool operator==(std::nullptr_t) const { return _ops == nullptr; }
+  bool operator!=(std::nullptr_t) const { return _ops != nullptr; }
+
+private:
+  typedef typename std::aligned_storage<SIZE>::type Storage;
+
+  struct Operations {
+    R (*invoke)(const Storage *, Args...);
+    void (*copy)(Storage *, const Storage *);
+    void (*destroy)(Storage *);
+  };
+
+  template <typename Callable> struct Ops {
+    static R invoke(const Storage *storage, Args... args) {
+      Callable &callable =
+          *const_cast<Callable *>(reinterpret_cast<const Callable *>(storage));
+      return callable(std::forward<Args>(args)...);
+    }
+    static void copy(Storage *to, const Storage *from) {
+      new (to) Callable(*reinterpret_cast<const Callable *>(from));
+    }
+    static void destroy(Storage *storage) {
+      reinterpret_cast<Callable *>(storage)->~Callable();
+    }
+    static const Operations OPS;
+  };
+
+  void reset() {
+    if (_ops != nullptr)
+      _ops->destroy(&_storage);
+    _ops = nullptr;
+  }
+
+  Storage _storage;
+  const Operations *_ops;
+};
+
+template <typename R, typename... Args, size_t SIZE>
+template <typename Callable>
+const typename Callback<R(Args...), SIZE>::Operations
+    Callback<R(Args...), SIZE>::Ops<Callable>::OPS = {invoke, copy, destroy};
+
+#endif // CALLBACK_H
@@ -0,0 +1,49 @@
+#include <utils/clock_sync.h>
+
+void ClockSync::clear() {
+  _samples = 0;
+  _has_reference = false;
+  _skew_ppm = 0;
+}
+
+void ClockSync::sample(uint32_t origin, uint32_t receive, uint32_t transmit,
+                       uint32_t received) {
+  int32_t round_trip = (int32_t)(received - origin);
+  int32_t remote_time = (int32_t)(transmit - receive);
+  if (round_trip < 0 || remote_time < 0 || remote_time > round_trip)
+    return;
+  Sample sample;
+  sample.delay = round_trip - remote_time;
+  sample.offset =
+      ((int64_t)(int32_t)(receive - origin) + (int32_t)(transmit - received)) /
+      2;
+  sample.at = received;
+  int32_t error = sample.offset - (int32_t)(remoteTime(received) - received);
+  if (synced() && (error > STEP || error < -STEP))
+    clear();
+  _window[_samples % SAMPLES] = sample;
+  _samples++;
+
+  int count = _samples < SAMPLES ? _samples : SAMPLES;
+  _best = _window[0];
+  for (int i = 1; i < count; i++)
+    if (_window[i].delay < _best.delay)
+      _best = _window[i];
+
+  if (!settled())
+    return;
+  if (!_has_reference) {
+    _reference = _best;
+    _has_reference = true;
+    return;
+  }
+  uint32_t baseline = _best.at - _reference.at;
+  if (baseline >= SKEW_BASELINE)
+    _skew_ppm = (int64_t)(_best.offset - _reference.offset) * 1000000 /
+                (int64_t)baseline;
+}
+
+uint32_t ClockSync::remoteTime(uint32_t local) const {
+  int32_t since = (int32_t)(local - _best.at);
+  return local + _best.offset + (int64_t)since * _skew_ppm / 1000000;
+}
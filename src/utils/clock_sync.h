@@ -0,0 +1,44 @@
+#ifndef CLOCK_SYNC_H
+#define CLOCK_SYNC_H
+
+#include <stdint.h>
+
+// Estimates a remote millis() clock from NTP-style exchanges. The offset is
+// taken from the exchange with the shortest round trip among the last SAMPLES,
+// the one least distorted by queueing; the skew from how that offset drifted
+// since the first estimate, once they are SKEW_BASELINE ms apart. An offset
+// off by more than STEP ms means the remote clock restarted and starts over.
+class ClockSync {
+public:
+  static const int SAMPLES = 8;
+  static const unsigned long SKEW_BASELINE = 60000;
+  static const long STEP = 1000;
+
+  ClockSync() { clear(); }
+
+  void clear();
+  // origin and received on the local clock, receive and transmit on the
+  // remote one.
+  void sample(uint32_t origin, uint32_t receive, uint32_t transmit,
+              uint32_t received);
+  bool synced() const { return _samples > 0; }
+  // Whether enough exchanges were made to trust the offset.
+  bool settled() const { return _samples >= SAMPLES; }
+  uint32_t remoteTime(uint32_t local) const;
+  long skewPpm() const { return _skew_ppm; }
+
+private:
+  struct Sample {
+    int32_t offset;
+    uint32_t delay;
+    uint32_t at;
+  };
+
+  Sample _window[SAMPLES];
+  int _samples;
+  Sample _best, _reference;
+  bool _has_reference;
+  long _skew_ppm;
+};
+
+#endif // CLOCK_SYNC_H
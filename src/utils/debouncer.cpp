@@ -1,11 +1,12 @@
 #include <Arduino.h>
+#include <clock.h>
 #include <utils/debouncer.h>
 
 Debouncer::Debouncer(unsigned long delay) : _delay(delay), _last_execution(0) {}
 bool Debouncer::operator()(std::function<void()> executor) {
-  if (millis() - _last_execution < _delay)
+  if (Clock::millis() - _last_execution < _delay)
     return false;
-  _last_execution = millis();
+  _last_execution = Clock::millis();
   executor();
   return true;
 }
\ No newline at end of file
@@ -0,0 +1,59 @@
+#include <Arduino.h>
+#include <math.h>
+#include <utils/phi_detector.h>
+
+// Logistic approximation of the normal distribution used to turn a delay of
+// y standard deviations past the mean into phi, and back.
+const float LOGISTIC_A = 1.5976f;
+const float LOGISTIC_B = 0.070566f;
+
+void PhiDetector::clear(unsigned long now, unsigned long interval) {
+  _intervals[0] = min(interval, 0xffffUL);
+  _samples = 1;
+  _next = 1;
+  _last = now;
+}
+
+void PhiDetector::heartbeat(unsigned long now) {
+  _intervals[_next] = min(now - _last, 0xffffUL);
+  _next = (_next + 1) % SAMPLES;
+  if (_samples < SAMPLES)
+    _samples++;
+  _last = now;
+}
+
+float PhiDetector::mean() const {
+  float total = 0;
+  for (int i = 0; i < _samples; i++)
+    total += _intervals[i];
+  return total / _samples;
+}
+
+float PhiDetector::stddev(unsigned long min_stddev) const {
+  float m = mean(), variance = 0;
+  for (int i = 0; i < _samples; i++)
+    variance += (_intervals[i] - m) * (_intervals[i] - m);
+  return max(sqrtf(variance / _samples), (float)min_stddev);
+}
+
+float PhiDetector::phi(unsigned long now, unsigned long min_stddev) const {
+  float m = mean();
+  float y = ((float)(now - _last) - m) / stddev(min_stddev);
+  float e = expf(-y * (LOGISTIC_A + LOGISTIC_B * y * y));
+  if (y > 0)
+    return -log10f(e / (1 + e));
+  return -log10f(1 - 1 / (1 + e));
+}
+
+unsigned long PhiDetector::suspectAt(float threshold,
+                                     unsigned long min_stddev) const {
+  // Solves y * (A + B y^2) = ln((1 - p) / p) for p = 10^-threshold, which
+  // grows with y, by Newton's method.
+  float p = powf(10, -threshold);
+  float target = logf((1 - p) / p);
+  float y = max(target / LOGISTIC_A, 0.0f);
+  for (int i = 0; i < 4; i++)
+    y -= (y * (LOGISTIC_A + LOGISTIC_B * y * y) - target) /
+         (LOGISTIC_A + 3 * LOGISTIC_B * y * y);
+  return _last + (unsigned long)max(mean() + y * stddev(min_stddev), 0.0f);
+}
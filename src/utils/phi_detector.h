@@ -0,0 +1,37 @@
+#ifndef PHI_DETECTOR_H
+#define PHI_DETECTOR_H
+
+#include <stdint.h>
+
+// Phi accrual failure detector (Hayashibara et al.), in milliseconds. Instead
+// of a yes/no timeout it gives phi, minus the log10 of the chance that a peer
+// whose heartbeats arrive as the last SAMPLES did is still alive this long
+// after the last one: phi 1 is a 10% chance, phi 3 a 0.1% one. Arrival
+// intervals are taken to be normally distributed, with a standard deviation of
+// at least `min_stddev` so that perfectly regular heartbeats do not make the
+// smallest delay look fatal.
+class PhiDetector {
+public:
+  static const int SAMPLES = 8;
+
+  PhiDetector() { clear(0, 0); }
+
+  // Starts over from a heartbeat at `now`, expecting the next ones every
+  // `interval`.
+  void clear(unsigned long now, unsigned long interval);
+  void heartbeat(unsigned long now);
+  unsigned long lastHeartbeat() const { return _last; }
+  float phi(unsigned long now, unsigned long min_stddev) const;
+  // When phi() reaches `threshold` if no heartbeat arrives before.
+  unsigned long suspectAt(float threshold, unsigned long min_stddev) const;
+
+private:
+  float mean() const;
+  float stddev(unsigned long min_stddev) const;
+
+  uint16_t _intervals[SAMPLES];
+  int _samples, _next;
+  unsigned long _last;
+};
+
+#endif // PHI_DETECTOR_H
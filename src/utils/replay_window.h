@@ -0,0 +1,44 @@
+#ifndef REPLAY_WINDOW_H
+#define REPLAY_WINDOW_H
+
+#include <stdint.h>
+
+// Accepts each sequence number once. Remembers the highest one seen and which
+// of the 64 below it already arrived; anything older is treated as a replay.
+class ReplayWindow {
+public:
+  static const uint32_t SIZE = 64;
+
+  ReplayWindow() { clear(); }
+
+  void clear() {
+    _highest = 0;
+    _seen = 0;
+  }
+
+  // Returns whether `sequence` is new, recording it if so.
+  bool accept(uint32_t sequence) {
+    if (_seen == 0) {
+      _highest = sequence;
+      _seen = 1;
+      return true;
+    }
+    int32_t ahead = (int32_t)(sequence - _highest);
+    if (ahead > 0) {
+      _seen = (uint32_t)ahead < SIZE ? (_seen << ahead) | 1 : 1;
+      _highest = sequence;
+      return true;
+    }
+    uint32_t behind = -ahead;
+    if (behind >= SIZE || (_seen >> behind) & 1)
+      return false;
+    _seen |= 1ull << behind;
+    return true;
+  }
+
+private:
+  uint32_t _highest;
+  uint64_t _seen; // bit i set when _highest - i arrived
+};
+
+#endif // REPLAY_WINDOW_H
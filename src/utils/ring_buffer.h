@@ -0,0 +1,56 @@
+#ifndef RING_BUFFER_H
+#define RING_BUFFER_H
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+
+// Fixed-size single-producer single-consumer queue. The producer fills the
+// slot returned by reserve() and publishes it with push(); the consumer reads
+// peek() and frees it with pop(). Neither side ever blocks or allocates.
+template <typename T, size_t N> class RingBuffer {
+public:
+  static_assert(N > 0 && (N & (N - 1)) == 0, "capacity must be a power of 2");
+
+  T *reserve() {
+    uint32_t head = _head.load(std::memory_order_relaxed);
+    if (head - _tail.load(std::memory_order_acquire) == N)
+      return nullptr;
+    return &_items[head & (N - 1)];
+  }
+
+  void push() {
+    _head.store(_head.load(std::memory_order_relaxed) + 1,
+                std::memory_order_release);
+  }
+
+  T *peek() {
+    uint32_t tail = _tail.load(std::memory_order_relaxed);
+    if (_head.load(std::memory_order_acquire) == tail)
+      return nullptr;
+    return &_items[tail & (N - 1)];
+  }
+
+  void pop() {
+    _tail.store(_tail.load(std::memory_order_relaxed) + 1,
+                std::memory_order_release);
+  }
+
+  // Consumer side: drops everything queued.
+  void clear() {
+    _tail.store(_head.load(std::memory_order_acquire),
+                std::memory_order_release);
+  }
+
+  size_t size() const {
+    return _head.load(std::memory_order_acquire) -
+           _tail.load(std::memory_order_acquire);
+  }
+
+private:
+  T _items[N];
+  std::atomic<uint32_t> _head{0};
+  std::atomic<uint32_t> _tail{0};
+};
+
+#endif // RING_BUFFER_H
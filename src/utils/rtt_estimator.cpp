@@ -0,0 +1,27 @@
+#include <Arduino.h>
+#include <utils/rtt_estimator.h>
+
+RttEstimator::RttEstimator(unsigned long initial_rto, unsigned long min_rto,
+                           unsigned long max_rto)
+    : _has_sample(false), _srtt(0), _rttvar(0), _rto(initial_rto),
+      _min_rto(min_rto), _max_rto(max_rto) {}
+
+void RttEstimator::sample(unsigned long rtt) {
+  long m = rtt;
+  if (!_has_sample) {
+    _has_sample = true;
+    _srtt = m << 3;
+    _rttvar = m << 1;
+  } else {
+    m -= _srtt >> 3;
+    _srtt += m;
+    if (m < 0)
+      m = -m;
+    m -= _rttvar >> 2;
+    _rttvar += m;
+  }
+  unsigned long rto = (_srtt >> 3) + _rttvar;
+  _rto = min(max(rto, _min_rto), _max_rto);
+}
+
+void RttEstimator::backoff() { _rto = min(_rto * 2, _max_rto); }
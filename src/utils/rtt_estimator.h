@@ -0,0 +1,21 @@
+#ifndef RTT_ESTIMATOR_H
+#define RTT_ESTIMATOR_H
+
+// Retransmission timeout from measured round trips (Jacobson/Karels), in
+// milliseconds. Only feed it samples from messages that were sent once.
+class RttEstimator {
+public:
+  RttEstimator(unsigned long initial_rto, unsigned long min_rto,
+               unsigned long max_rto);
+  void sample(unsigned long rtt);
+  void backoff();
+  unsigned long rto() const { return _rto; }
+
+private:
+  bool _has_sample;
+  long _srtt;   // smoothed round trip, scaled by 8
+  long _rttvar; // round trip variation, scaled by 4
+  unsigned long _rto, _min_rto, _max_rto;
+};
+
+#endif // RTT_ESTIMATOR_H
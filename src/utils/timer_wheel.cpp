@@ -0,0 +1,129 @@
+#include <utils/timer_wheel.h>
+
+TimerWheel::TimerWheel() : _base(0), _count(0), _running(false) {
+  for (unsigned long i = 0; i < LEVEL0_SLOTS; i++)
+    _level0[i] = nullptr;
+  for (unsigned long i = 0; i < LEVEL1_SLOTS; i++)
+    _level1[i] = nullptr;
+}
+
+void TimerWheel::link(Timer *&slot, Timer &timer) {
+  timer._next = slot;
+  if (slot != nullptr)
+    slot->_pprev = &timer._next;
+  timer._pprev = &slot;
+  slot = &timer;
+}
+
+// Also clears the bit of the slot when `timer` was the last one in it.
+void TimerWheel::unlink(Timer &timer) {
+  Timer **pprev = timer._pprev;
+  *pprev = timer._next;
+  if (timer._next != nullptr)
+    timer._next->_pprev = pprev;
+  timer._next = nullptr;
+  timer._pprev = nullptr;
+  if (*pprev != nullptr)
+    return;
+  if (pprev >= _level0 && pprev < _level0 + LEVEL0_SLOTS)
+    _level0_used.reset(pprev - _level0);
+  else if (pprev >= _level1 && pprev < _level1 + LEVEL1_SLOTS)
+    _level1_used.reset(pprev - _level1);
+}
+
+void TimerWheel::insert(Timer &timer) {
+  long ticks = (long)(timer._deadline - _base);
+  if (ticks < 0 || (unsigned long)ticks < LEVEL0_SLOTS) {
+    unsigned long at = ticks < 0 ? _base : timer._deadline;
+    int slot = at & (LEVEL0_SLOTS - 1);
+    link(_level0[slot], timer);
+    _level0_used.set(slot);
+  } else {
+    unsigned long at =
+        (unsigned long)ticks < HORIZON ? timer._deadline : _base + HORIZON - 1;
+    int slot = (at >> LEVEL0_BITS) & (LEVEL1_SLOTS - 1);
+    link(_level1[slot], timer);
+    _level1_used.set(slot);
+  }
+}
+
+void TimerWheel::start(Timer &timer, unsigned long now, unsigned long delay,
+                       unsigned long period) {
+  if (timer.running())
+    stop(timer);
+  // An empty wheel skips the ticks it slept through, unless run() is walking
+  // them: it is still behind `now` and the timer must land in a slot it has
+  // yet to reach.
+  if (_count == 0 && !_running)
+    _base = now;
+  timer._deadline = now + delay;
+  timer._period = period;
+  insert(timer);
+  _count++;
+}
+
+void TimerWheel::stop(Timer &timer) {
+  if (!timer.running())
+    return;
+  unlink(timer);
+  _count--;
+}
+
+// Moves the timers of the second level slot that starts at _base down.
+void TimerWheel::cascade() {
+  Timer *&slot = _level1[(_base >> LEVEL0_BITS) & (LEVEL1_SLOTS - 1)];
+  while (slot != nullptr) {
+    Timer &timer = *slot;
+    unlink(timer);
+    insert(timer);
+  }
+}
+
+void TimerWheel::run(unsigned long now) {
+  _running = true;
+  while (_count > 0 && (long)(now - _base) >= 0) {
+    if ((_base & (LEVEL0_SLOTS - 1)) == 0)
+      cascade();
+    Timer *&slot = _level0[_base & (LEVEL0_SLOTS - 1)];
+    while (slot != nullptr) {
+      Timer &timer = *slot;
+      unlink(timer);
+      _count--;
+      if (timer._period != 0) {
+        timer._deadline += timer._period;
+        if ((long)(timer._deadline - now) <= 0)
+          timer._deadline = now + timer._period;
+        insert(timer);
+        _count++;
+      }
+      timer.callback();
+    }
+    _base++;
+  }
+  _running = false;
+  if (_count == 0)
+    _base = now + 1;
+}
+
+bool TimerWheel::nextDeadline(unsigned long &deadline) const {
+  if (_count == 0)
+    return false;
+  // Timers already on the first level can be due after the next cascade, so
+  // look at both.
+  bool found = false;
+  int slot = _level0_used.next(_base & (LEVEL0_SLOTS - 1));
+  if (slot >= 0) {
+    deadline = _base + ((slot - _base) & (LEVEL0_SLOTS - 1));
+    found = true;
+  }
+  unsigned long first = (_base + LEVEL0_SLOTS - 1) >> LEVEL0_BITS;
+  slot = _level1_used.next(first & (LEVEL1_SLOTS - 1));
+  if (slot >= 0) {
+    unsigned long cascade = (first + ((slot - first) & (LEVEL1_SLOTS - 1)))
+                            << LEVEL0_BITS;
+    if (!found || (long)(cascade - deadline) < 0)
+      deadline = cascade;
+    found = true;
+  }
+  return found;
+}
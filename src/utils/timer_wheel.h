@@ -0,0 +1,67 @@
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
+
+#include <stdint.h>
+#include <utils/bitset.h>
+
+// One-shot or periodic callback run by a TimerWheel. Timers are owned by the
+// caller and linked into the wheel, which never allocates.
+struct Timer {
+  Timer(void (*callback)()) : callback(callback) {}
+
+  bool running() const { return _pprev != nullptr; }
+
+  void (*callback)();
+
+private:
+  friend class TimerWheel;
+  unsigned long _deadline = 0;
+  unsigned long _period = 0;
+  Timer *_next = nullptr;
+  Timer **_pprev = nullptr;
+};
+
+// Hierarchical timing wheel with 1 ms ticks: the first level has a slot per
+// tick for the next 256 ms, the second a slot per 256 ms for the next 16 s.
+// Timers move down a level as their time comes closer, and ones further out
+// wait in the last slot and are placed again. Starting, stopping and expiring
+// a timer are O(1), and so is finding the next deadline thanks to a bitmap of
+// the slots in use.
+class TimerWheel {
+public:
+  TimerWheel();
+
+  // Runs `timer` `delay` ms after `now`, then every `period` ms unless 0.
+  // Starting a running timer moves it.
+  void start(Timer &timer, unsigned long now, unsigned long delay,
+             unsigned long period = 0);
+  void stop(Timer &timer);
+  // Runs the callbacks of every timer due at or before `now`.
+  void run(unsigned long now);
+  // Sets `deadline` to when the next timer is due, or to when timers of the
+  // second level move down if that comes first, and returns true, or returns
+  // false if none is running.
+  bool nextDeadline(unsigned long &deadline) const;
+
+private:
+  static const int LEVEL0_BITS = 8;
+  static const int LEVEL1_BITS = 6;
+  static const unsigned long LEVEL0_SLOTS = 1ul << LEVEL0_BITS;
+  static const unsigned long LEVEL1_SLOTS = 1ul << LEVEL1_BITS;
+  static const unsigned long HORIZON = LEVEL0_SLOTS * LEVEL1_SLOTS;
+
+  void insert(Timer &timer);
+  void cascade();
+  static void link(Timer *&slot, Timer &timer);
+  void unlink(Timer &timer);
+
+  Timer *_level0[LEVEL0_SLOTS];
+  Timer *_level1[LEVEL1_SLOTS];
+  Bitset<LEVEL0_SLOTS> _level0_used;
+  Bitset<LEVEL1_SLOTS> _level1_used;
+  unsigned long _base; // next tick to run
+  int _count;
+  bool _running; // inside run(), which owns _base
+};
+
+#endif // TIMER_WHEEL_H
@@ -0,0 +1,100 @@
+#ifndef WIRE_H
+#define WIRE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+// Compile-time description of the packed, little-endian payloads sent over the
+// air. A schema lists its fields in order, each one placed right after the
+// previous, and reports its total SIZE:
+//
+//   struct PointWire {
+//     using X = Wire::Field<uint16_t>;
+//     using Y = Wire::Field<uint16_t, X>;
+//     static constexpr size_t SIZE = Y::END;
+//   };
+//
+// Received payloads are read in place through a View, which refuses buffers
+// shorter than the schema.
+namespace Wire {
+struct Start {
+  static constexpr size_t END = 0;
+};
+
+template <typename T, typename After = Start> struct Field {
+  using Type = T;
+  static constexpr size_t OFFSET = After::END;
+  static constexpr size_t END = OFFSET + sizeof(T);
+
+  static T read(const uint8_t *data) {
+    T value = 0;
+    for (size_t i = 0; i < sizeof(T); i++)
+      value |= (T)((T)data[i] << (8 * i));
+    return value;
+  }
+
+  static void write(uint8_t *data, T value) {
+    for (size_t i = 0; i < sizeof(T); i++)
+      data[i] = (uint8_t)(value >> (8 * i));
+  }
+};
+
+template <typename After> struct Field<bool, After> {
+  using Type = bool;
+  static constexpr size_t OFFSET = After::END;
+  static constexpr size_t END = OFFSET + 1;
+
+  static bool read(const uint8_t *data) { return data[0] != 0; }
+  static void write(uint8_t *data, bool value) { data[0] = value; }
+};
+
+// Fixed-size byte string, not null-terminated on the wire.
+template <size_t N, typename After = Start> struct Bytes {
+  using Type = const uint8_t *;
+  static constexpr size_t OFFSET = After::END;
+  static constexpr size_t END = OFFSET + N;
+  static constexpr size_t SIZE = N;
+
+  static const uint8_t *read(const uint8_t *data) { return data; }
+  static void write(uint8_t *data, const void *value) {
+    memcpy(data, value, N);
+  }
+};
+
+template <typename Schema> class View {
+public:
+  View(const uint8_t *data, size_t len)
+      : _data(len >= Schema::SIZE ? data : nullptr) {}
+
+  bool valid() const { return _data != nullptr; }
+
+  template <typename F> typename F::Type get() const {
+    static_assert(F::END <= Schema::SIZE, "field outside of the schema");
+    return F::read(_data + F::OFFSET);
+  }
+
+private:
+  const uint8_t *_data;
+};
+
+template <typename Schema> class Writer {
+public:
+  Writer(uint8_t *data) : _data(data) {}
+
+  template <typename F, typename T> void set(T value) {
+    static_assert(F::END <= Schema::SIZE, "field outside of the schema");
+    F::write(_data + F::OFFSET, value);
+  }
+
+private:
+  uint8_t *_data;
+};
+
+// Schema of messages without payload.
+struct Empty {
+  static constexpr size_t SIZE = 0;
+};
+} // namespace Wire
+
+#endif // WIRE_H
@@ -0,0 +1,91 @@
+#include <stdint.h>
+#include <unity.h>
+#include <utils/callback.h>
+
+namespace {
+// Counts its live copies, to check that Callback destroys what it holds.
+struct Tracked {
+  static int alive;
+  int calls = 0;
+  Tracked() { alive++; }
+  Tracked(const Tracked &other) : calls(other.calls) { alive++; }
+  ~Tracked() { alive--; }
+  int operator()() { return ++calls; }
+};
+int Tracked::alive = 0;
+
+// Exactly as large as the Callback's storage.
+struct Filling {
+  uint8_t bytes[16];
+  int operator()() const { return bytes[0] + bytes[15]; }
+};
+} // namespace
+
+void setUp() { Tracked::alive = 0; }
+
+void tearDown() {}
+
+void testEmpty() {
+  Callback<void(), 16> callback;
+  TEST_ASSERT_FALSE(callback);
+  TEST_ASSERT_TRUE(callback == nullptr);
+  callback = [] {};
+  TEST_ASSERT_TRUE(callback);
+  TEST_ASSERT_TRUE(callback != nullptr);
+  callback = nullptr;
+  TEST_ASSERT_FALSE(callback);
+}
+
+void testCallsCapture() {
+  int total = 0;
+  Callback<void(int), 16> add = [&total](int value) { total += value; };
+  add(2);
+  add(3);
+  TEST_ASSERT_EQUAL(5, total);
+  Callback<int(int, int), 16> multiply = [](int a, int b) { return a * b; };
+  TEST_ASSERT_EQUAL(42, multiply(6, 7));
+}
+
+void testFillsStorage() {
+  Filling filling;
+  for (int i = 0; i < 16; i++)
+    filling.bytes[i] = i;
+  Callback<int(), sizeof(Filling)> callback = filling;
+  Callback<int(), sizeof(Filling)> copy = callback;
+  TEST_ASSERT_EQUAL(15, copy());
+}
+
+void testCopiesAreIndependent() {
+  Callback<int(), 16> original = Tracked();
+  TEST_ASSERT_EQUAL(1, original());
+  Callback<int(), 16> copy = original;
+  TEST_ASSERT_EQUAL(2, copy());
+  TEST_ASSERT_EQUAL(2, original());
+  copy = original;
+  TEST_ASSERT_EQUAL(3, copy());
+  TEST_ASSERT_EQUAL(2, Tracked::alive);
+}
+
+void testDestroysCallable() {
+  {
+    Callback<int(), 16> callback = Tracked();
+    Callback<int(), 16> copy = callback;
+    TEST_ASSERT_EQUAL(2, Tracked::alive);
+    callback = nullptr;
+    TEST_ASSERT_EQUAL(1, Tracked::alive);
+    copy = [] { return 0; };
+    TEST_ASSERT_EQUAL(0, Tracked::alive);
+    callback = Tracked();
+  }
+  TEST_ASSERT_EQUAL(0, Tracked::alive);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(testEmpty);
+  RUN_TEST(testCallsCapture);
+  RUN_TEST(testFillsStorage);
+  RUN_TEST(testCopiesAreIndependent);
+  RUN_TEST(testDestroysCallable);
+  return UNITY_END();
+}
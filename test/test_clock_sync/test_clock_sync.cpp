@@ -0,0 +1,106 @@
+#include <unity.h>
+#include <utils/clock_sync.h>
+
+namespace {
+// The remote clock as a function of the local one.
+long _offset;
+long _skew_ppm;
+uint32_t _start;
+
+uint32_t remoteAt(uint32_t local) {
+  return local + _offset +
+         (int64_t)(int32_t)(local - _start) * _skew_ppm / 1000000;
+}
+
+// One exchange sent at `origin`, taking `out` and `back` ms on the way to the
+// remote clock and back, and `hold` ms there.
+void exchange(ClockSync &clock, uint32_t origin, uint32_t out, uint32_t back,
+              uint32_t hold = 1) {
+  uint32_t receive = remoteAt(origin + out);
+  uint32_t transmit = receive + hold;
+  uint32_t received = origin + out + hold + back;
+  clock.sample(origin, receive, transmit, received);
+}
+} // namespace
+
+void setUp() {
+  _offset = 5000;
+  _skew_ppm = 0;
+  _start = 0;
+}
+
+void tearDown() {}
+
+void testSymmetricExchange() {
+  ClockSync clock;
+  TEST_ASSERT_FALSE(clock.synced());
+  exchange(clock, 1000, 10, 10);
+  TEST_ASSERT_TRUE(clock.synced());
+  TEST_ASSERT_FALSE(clock.settled());
+  TEST_ASSERT_EQUAL_UINT32(7000, clock.remoteTime(2000));
+}
+
+void testShortestRoundTripWins() {
+  ClockSync clock;
+  // Queueing on the way out makes the remote clock look 50 ms ahead.
+  exchange(clock, 1000, 110, 10);
+  TEST_ASSERT_EQUAL_UINT32(7050, clock.remoteTime(2000));
+  exchange(clock, 1200, 5, 5);
+  TEST_ASSERT_EQUAL_UINT32(7000, clock.remoteTime(2000));
+  for (uint32_t at = 1400; at < 2400; at += 200)
+    exchange(clock, at, 110, 10);
+  TEST_ASSERT_EQUAL_UINT32(7000, clock.remoteTime(2000));
+  // Once the fast exchange leaves the window the best slow one is used.
+  for (int i = 0; i < ClockSync::SAMPLES; i++)
+    exchange(clock, 3000 + i * 200, 110, 10);
+  TEST_ASSERT_EQUAL_UINT32(7050, clock.remoteTime(2000));
+}
+
+void testRejectsImpossibleExchanges() {
+  ClockSync clock;
+  // The remote side claims to have held the request longer than the round
+  // trip took.
+  clock.sample(1000, 6000, 6100, 1050);
+  TEST_ASSERT_FALSE(clock.synced());
+}
+
+void testSettles() {
+  ClockSync clock;
+  for (int i = 0; i < ClockSync::SAMPLES; i++) {
+    TEST_ASSERT_FALSE(clock.settled());
+    exchange(clock, 1000 + i * 250, 10, 10);
+  }
+  TEST_ASSERT_TRUE(clock.settled());
+}
+
+void testSkew() {
+  ClockSync clock;
+  _skew_ppm = 100;
+  for (uint32_t at = 0; at <= 300000; at += 1000)
+    exchange(clock, at, 10, 10);
+  TEST_ASSERT_INT_WITHIN(10, 100, clock.skewPpm());
+  // A minute later the estimate is still within a millisecond or two.
+  TEST_ASSERT_UINT32_WITHIN(2, remoteAt(360000), clock.remoteTime(360000));
+}
+
+void testRemoteRestart() {
+  ClockSync clock;
+  for (int i = 0; i < ClockSync::SAMPLES; i++)
+    exchange(clock, 1000 + i * 250, 10, 10);
+  TEST_ASSERT_TRUE(clock.settled());
+  _offset = -500;
+  exchange(clock, 4000, 10, 10);
+  TEST_ASSERT_FALSE(clock.settled());
+  TEST_ASSERT_EQUAL_UINT32(4500, clock.remoteTime(5000));
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(testSymmetricExchange);
+  RUN_TEST(testShortestRoundTripWins);
+  RUN_TEST(testRejectsImpossibleExchanges);
+  RUN_TEST(testSettles);
+  RUN_TEST(testSkew);
+  RUN_TEST(testRemoteRestart);
+  return UNITY_END();
+}
@@ -0,0 +1,109 @@
+#include <peer_table.h>
+#include <stdint.h>
+#include <string.h>
+#include <unity.h>
+
+namespace {
+const int CAPACITY = 16;
+
+uint32_t _seed;
+
+void randomMac(uint8_t *mac) {
+  for (int i = 0; i < 6; i++) {
+    _seed = _seed * 1664525 + 1013904223;
+    mac[i] = _seed >> 24;
+  }
+}
+
+// Every peer in `macs` must be found at the index that holds its MAC.
+bool findsAll(const PeerTable<CAPACITY> &table, uint8_t macs[][6], int count) {
+  if (table.size() != count)
+    return false;
+  for (int i = 0; i < count; i++) {
+    int index = table.find(macs[i]);
+    if (index == PeerTable<CAPACITY>::NONE ||
+        memcmp(table.mac(index), macs[i], 6) != 0)
+      return false;
+  }
+  return true;
+}
+} // namespace
+
+void setUp() { _seed = 1; }
+
+void tearDown() {}
+
+void testAddAndFind() {
+  PeerTable<CAPACITY> table;
+  uint8_t macs[CAPACITY + 1][6];
+  for (int i = 0; i <= CAPACITY; i++)
+    randomMac(macs[i]);
+  TEST_ASSERT_EQUAL(PeerTable<CAPACITY>::NONE, table.find(macs[0]));
+  for (int i = 0; i < CAPACITY; i++)
+    TEST_ASSERT_EQUAL(i, table.add(macs[i]));
+  TEST_ASSERT_TRUE(table.full());
+  TEST_ASSERT_EQUAL(3, table.add(macs[3]));
+  TEST_ASSERT_EQUAL(PeerTable<CAPACITY>::NONE, table.add(macs[CAPACITY]));
+  TEST_ASSERT_EQUAL(PeerTable<CAPACITY>::NONE, table.find(macs[CAPACITY]));
+  TEST_ASSERT_TRUE(findsAll(table, macs, CAPACITY));
+}
+
+void testRemoveMovesLastPeer() {
+  PeerTable<CAPACITY> table;
+  uint8_t macs[3][6];
+  for (int i = 0; i < 3; i++) {
+    randomMac(macs[i]);
+    table.add(macs[i]);
+  }
+  TEST_ASSERT_TRUE(table.remove(macs[0]));
+  TEST_ASSERT_FALSE(table.remove(macs[0]));
+  TEST_ASSERT_EQUAL(2, table.size());
+  TEST_ASSERT_EQUAL(0, table.find(macs[2]));
+  TEST_ASSERT_EQUAL(1, table.find(macs[1]));
+  TEST_ASSERT_EQUAL_MEMORY(macs[2], table.mac(0), 6);
+  TEST_ASSERT_EQUAL(PeerTable<CAPACITY>::NONE, table.find(macs[0]));
+}
+
+void testRemoveKeepsProbeChains() {
+  // A full table is half empty, so probe chains form and wrap around the end
+  // of the slots. Removing peers in a scrambled order has to keep every other
+  // peer reachable.
+  PeerTable<CAPACITY> table;
+  uint8_t macs[CAPACITY][6];
+  int count = 0;
+  for (int round = 0; round < 2000; round++) {
+    if (count < CAPACITY && (count == 0 || _seed % 3 != 0)) {
+      randomMac(macs[count]);
+      TEST_ASSERT_EQUAL(count, table.add(macs[count]));
+      count++;
+    } else {
+      _seed = _seed * 1664525 + 1013904223;
+      int victim = (_seed >> 16) % count;
+      TEST_ASSERT_TRUE(table.remove(macs[victim]));
+      TEST_ASSERT_EQUAL(PeerTable<CAPACITY>::NONE, table.find(macs[victim]));
+      memcpy(macs[victim], macs[count - 1], 6);
+      count--;
+    }
+    TEST_ASSERT_TRUE(findsAll(table, macs, count));
+  }
+}
+
+void testClear() {
+  PeerTable<CAPACITY> table;
+  uint8_t mac[6];
+  randomMac(mac);
+  table.add(mac);
+  table.clear();
+  TEST_ASSERT_EQUAL(0, table.size());
+  TEST_ASSERT_EQUAL(PeerTable<CAPACITY>::NONE, table.find(mac));
+  TEST_ASSERT_EQUAL(0, table.add(mac));
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(testAddAndFind);
+  RUN_TEST(testRemoveMovesLastPeer);
+  RUN_TEST(testRemoveKeepsProbeChains);
+  RUN_TEST(testClear);
+  return UNITY_END();
+}
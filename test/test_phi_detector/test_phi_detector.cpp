@@ -0,0 +1,92 @@
+#include <unity.h>
+#include <utils/phi_detector.h>
+
+namespace {
+const unsigned long INTERVAL = 1000;
+const unsigned long MIN_STDDEV = 500;
+
+// A detector that heard `beats` heartbeats INTERVAL apart, the last at
+// `beats * INTERVAL`.
+PhiDetector regular(int beats) {
+  PhiDetector detector;
+  detector.clear(0, INTERVAL);
+  for (int i = 1; i <= beats; i++)
+    detector.heartbeat(i * INTERVAL);
+  return detector;
+}
+} // namespace
+
+void setUp() {}
+
+void tearDown() {}
+
+void testPhiGrowsWithSilence() {
+  PhiDetector detector = regular(PhiDetector::SAMPLES);
+  unsigned long last = detector.lastHeartbeat();
+  TEST_ASSERT_EQUAL_UINT32(PhiDetector::SAMPLES * INTERVAL, last);
+  float previous = detector.phi(last, MIN_STDDEV);
+  for (unsigned long silence = 250; silence <= 5000; silence += 250) {
+    float phi = detector.phi(last + silence, MIN_STDDEV);
+    TEST_ASSERT_GREATER_THAN(previous, phi);
+    previous = phi;
+  }
+  // An answer on time is no cause for suspicion.
+  TEST_ASSERT_LESS_THAN(1.0f, detector.phi(last + INTERVAL, MIN_STDDEV));
+}
+
+void testSuspectAt() {
+  PhiDetector detector = regular(PhiDetector::SAMPLES);
+  unsigned long last = detector.lastHeartbeat();
+  // Regular heartbeats leave only the floor as deviation: phi 8 is reached
+  // about 5.2 deviations past the mean interval.
+  unsigned long at = detector.suspectAt(8, MIN_STDDEV);
+  TEST_ASSERT_UINT32_WITHIN(20, last + 3610, at);
+  TEST_ASSERT_FLOAT_WITHIN(0.1f, 8, detector.phi(at, MIN_STDDEV));
+  at = detector.suspectAt(3, MIN_STDDEV);
+  TEST_ASSERT_FLOAT_WITHIN(0.1f, 3, detector.phi(at, MIN_STDDEV));
+}
+
+void testDeviationFloor() {
+  PhiDetector detector = regular(PhiDetector::SAMPLES);
+  TEST_ASSERT_LESS_THAN(detector.suspectAt(8, MIN_STDDEV),
+                        detector.suspectAt(8, 200));
+}
+
+void testJitterDelaysSuspicion() {
+  PhiDetector steady = regular(PhiDetector::SAMPLES);
+  PhiDetector jittery;
+  jittery.clear(0, INTERVAL);
+  unsigned long now = 0;
+  for (int i = 1; i <= PhiDetector::SAMPLES; i++) {
+    now += i % 2 ? 200 : 1800;
+    jittery.heartbeat(now);
+  }
+  TEST_ASSERT_EQUAL_UINT32(steady.lastHeartbeat(), jittery.lastHeartbeat());
+  TEST_ASSERT_GREATER_THAN(steady.suspectAt(8, MIN_STDDEV),
+                           jittery.suspectAt(8, MIN_STDDEV));
+}
+
+void testKeepsLastSamples() {
+  // Fast countdown heartbeats leave the window after SAMPLES slower ones.
+  PhiDetector detector;
+  detector.clear(0, 100);
+  unsigned long now = 0;
+  for (int i = 0; i < 20; i++)
+    detector.heartbeat(now += 100);
+  unsigned long early = detector.suspectAt(8, MIN_STDDEV) - now;
+  for (int i = 0; i < PhiDetector::SAMPLES; i++)
+    detector.heartbeat(now += INTERVAL);
+  unsigned long late = detector.suspectAt(8, MIN_STDDEV) - now;
+  TEST_ASSERT_UINT32_WITHIN(20, 3610, late);
+  TEST_ASSERT_LESS_THAN(late, early);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(testPhiGrowsWithSilence);
+  RUN_TEST(testSuspectAt);
+  RUN_TEST(testDeviationFloor);
+  RUN_TEST(testJitterDelaysSuspicion);
+  RUN_TEST(testKeepsLastSamples);
+  return UNITY_END();
+}
@@ -0,0 +1,78 @@
+#include <unity.h>
+#include <utils/replay_window.h>
+
+void setUp() {}
+
+void tearDown() {}
+
+void testInOrder() {
+  ReplayWindow window;
+  for (uint32_t sequence = 1; sequence <= 200; sequence++)
+    TEST_ASSERT_TRUE(window.accept(sequence));
+  TEST_ASSERT_FALSE(window.accept(200));
+  TEST_ASSERT_FALSE(window.accept(150));
+}
+
+void testOutOfOrder() {
+  ReplayWindow window;
+  TEST_ASSERT_TRUE(window.accept(10));
+  TEST_ASSERT_TRUE(window.accept(5));
+  TEST_ASSERT_FALSE(window.accept(5));
+  TEST_ASSERT_TRUE(window.accept(7));
+  TEST_ASSERT_FALSE(window.accept(10));
+  TEST_ASSERT_TRUE(window.accept(12));
+  TEST_ASSERT_TRUE(window.accept(11));
+  TEST_ASSERT_FALSE(window.accept(7));
+}
+
+void testTooOld() {
+  ReplayWindow window;
+  TEST_ASSERT_TRUE(window.accept(100));
+  TEST_ASSERT_TRUE(window.accept(100 - (ReplayWindow::SIZE - 1)));
+  TEST_ASSERT_FALSE(window.accept(100 - ReplayWindow::SIZE));
+}
+
+void testJumpAhead() {
+  ReplayWindow window;
+  TEST_ASSERT_TRUE(window.accept(1));
+  TEST_ASSERT_TRUE(window.accept(2));
+  TEST_ASSERT_TRUE(window.accept(1000));
+  TEST_ASSERT_TRUE(window.accept(999));
+  TEST_ASSERT_FALSE(window.accept(2));
+  // Exactly one window ahead shifts every earlier bit out.
+  TEST_ASSERT_TRUE(window.accept(1000 + ReplayWindow::SIZE));
+  TEST_ASSERT_FALSE(window.accept(1000));
+  TEST_ASSERT_TRUE(window.accept(1001));
+}
+
+void testWrapsAround() {
+  ReplayWindow window;
+  uint32_t first = 0xfffffff0;
+  for (uint32_t sequence = first; sequence != 0x10; sequence += 2)
+    TEST_ASSERT_TRUE(window.accept(sequence));
+  TEST_ASSERT_FALSE(window.accept(0xfffffff4));
+  TEST_ASSERT_FALSE(window.accept(0x2));
+  TEST_ASSERT_TRUE(window.accept(0xfffffff5));
+  TEST_ASSERT_TRUE(window.accept(0x3));
+  TEST_ASSERT_FALSE(window.accept(first - ReplayWindow::SIZE));
+}
+
+void testClear() {
+  ReplayWindow window;
+  TEST_ASSERT_TRUE(window.accept(500));
+  window.clear();
+  TEST_ASSERT_TRUE(window.accept(1));
+  TEST_ASSERT_TRUE(window.accept(500));
+  TEST_ASSERT_FALSE(window.accept(1));
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(testInOrder);
+  RUN_TEST(testOutOfOrder);
+  RUN_TEST(testTooOld);
+  RUN_TEST(testJumpAhead);
+  RUN_TEST(testWrapsAround);
+  RUN_TEST(testClear);
+  return UNITY_END();
+}
@@ -0,0 +1,97 @@
+#include <stdint.h>
+#include <thread>
+#include <unity.h>
+#include <utils/ring_buffer.h>
+
+void setUp() {}
+
+void tearDown() {}
+
+void testFifo() {
+  RingBuffer<int, 4> buffer;
+  TEST_ASSERT_NULL(buffer.peek());
+  for (int i = 0; i < 4; i++) {
+    int *slot = buffer.reserve();
+    TEST_ASSERT_NOT_NULL(slot);
+    *slot = i;
+    buffer.push();
+  }
+  TEST_ASSERT_NULL(buffer.reserve());
+  TEST_ASSERT_EQUAL(4, buffer.size());
+  for (int i = 0; i < 4; i++) {
+    TEST_ASSERT_EQUAL(i, *buffer.peek());
+    buffer.pop();
+  }
+  TEST_ASSERT_NULL(buffer.peek());
+  TEST_ASSERT_EQUAL(0, buffer.size());
+}
+
+void testWrapsAround() {
+  RingBuffer<int, 4> buffer;
+  int pushed = 0, popped = 0;
+  // Refills the buffer and drains most of it, so the slots are reused at a
+  // different offset every round.
+  for (int round = 0; round < 100; round++) {
+    while (int *slot = buffer.reserve()) {
+      *slot = pushed++;
+      buffer.push();
+    }
+    for (int i = 0; i < 3; i++) {
+      TEST_ASSERT_EQUAL(popped++, *buffer.peek());
+      buffer.pop();
+    }
+  }
+  TEST_ASSERT_EQUAL(pushed - popped, buffer.size());
+}
+
+void testProducerAndConsumerThreads() {
+  static RingBuffer<uint32_t, 8> buffer;
+  const uint32_t COUNT = 100000;
+  std::thread producer([] {
+    for (uint32_t i = 0; i < COUNT;) {
+      uint32_t *slot = buffer.reserve();
+      if (slot == nullptr) {
+        std::this_thread::yield();
+        continue;
+      }
+      *slot = i++;
+      buffer.push();
+    }
+  });
+  uint32_t expected = 0, mismatches = 0;
+  while (expected < COUNT) {
+    uint32_t *item = buffer.peek();
+    if (item == nullptr) {
+      std::this_thread::yield();
+      continue;
+    }
+    if (*item != expected)
+      mismatches++;
+    expected++;
+    buffer.pop();
+  }
+  producer.join();
+  TEST_ASSERT_EQUAL(0, mismatches);
+  TEST_ASSERT_EQUAL(0, buffer.size());
+}
+
+void testClear() {
+  RingBuffer<int, 4> buffer;
+  for (int i = 0; i < 3; i++) {
+    *buffer.reserve() = i;
+    buffer.push();
+  }
+  buffer.clear();
+  TEST_ASSERT_EQUAL(0, buffer.size());
+  TEST_ASSERT_NULL(buffer.peek());
+  TEST_ASSERT_NOT_NULL(buffer.reserve());
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(testFifo);
+  RUN_TEST(testWrapsAround);
+  RUN_TEST(testProducerAndConsumerThreads);
+  RUN_TEST(testClear);
+  return UNITY_END();
+}
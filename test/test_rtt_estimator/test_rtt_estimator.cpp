@@ -0,0 +1,68 @@
+#include <unity.h>
+#include <utils/rtt_estimator.h>
+
+void setUp() {}
+
+void tearDown() {}
+
+void testInitialTimeout() {
+  RttEstimator estimator(100, 20, 1000);
+  TEST_ASSERT_EQUAL(100, estimator.rto());
+}
+
+void testFirstSample() {
+  RttEstimator estimator(100, 20, 1000);
+  // The first round trip sets the mean and half of it as the variation.
+  estimator.sample(40);
+  TEST_ASSERT_EQUAL(40 + 4 * 20, estimator.rto());
+}
+
+void testSteadyRoundTrips() {
+  RttEstimator estimator(100, 20, 1000);
+  for (int i = 0; i < 50; i++)
+    estimator.sample(200);
+  TEST_ASSERT_UINT32_WITHIN(5, 200, estimator.rto());
+  for (int i = 0; i < 50; i++)
+    estimator.sample(5);
+  TEST_ASSERT_EQUAL(20, estimator.rto());
+}
+
+void testVariationRaisesTimeout() {
+  RttEstimator estimator(100, 20, 1000);
+  for (int i = 0; i < 50; i++)
+    estimator.sample(i % 2 ? 20 : 80);
+  TEST_ASSERT_GREATER_THAN(80, estimator.rto());
+}
+
+void testBackoff() {
+  RttEstimator estimator(100, 20, 1000);
+  estimator.backoff();
+  TEST_ASSERT_EQUAL(200, estimator.rto());
+  estimator.backoff();
+  estimator.backoff();
+  TEST_ASSERT_EQUAL(800, estimator.rto());
+  estimator.backoff();
+  TEST_ASSERT_EQUAL(1000, estimator.rto());
+  estimator.sample(40);
+  TEST_ASSERT_EQUAL(120, estimator.rto());
+}
+
+void testZeroRoundTrip() {
+  RttEstimator estimator(100, 20, 1000);
+  // A 0 ms round trip is a sample like any other, so the 100 ms one after it
+  // only moves the mean by an eighth.
+  estimator.sample(0);
+  estimator.sample(100);
+  TEST_ASSERT_EQUAL(100 / 8 + 100, estimator.rto());
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(testInitialTimeout);
+  RUN_TEST(testFirstSample);
+  RUN_TEST(testSteadyRoundTrips);
+  RUN_TEST(testVariationRaisesTimeout);
+  RUN_TEST(testBackoff);
+  RUN_TEST(testZeroRoundTrip);
+  return UNITY_END();
+}
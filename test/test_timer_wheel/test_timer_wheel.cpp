@@ -0,0 +1,121 @@
+#include <unity.h>
+#include <utils/timer_wheel.h>
+
+namespace {
+TimerWheel *_wheel;
+int _fired_a, _fired_b;
+unsigned long _now;
+
+void fireA() { _fired_a++; }
+void fireB() { _fired_b++; }
+Timer _b(fireB);
+// Starts B from inside a callback, due right away.
+void startB() {
+  _fired_a++;
+  _wheel->start(_b, _now, 0);
+}
+Timer _rearmed(nullptr);
+void rearm() {
+  _fired_a++;
+  if (_fired_a < 3)
+    _wheel->start(_rearmed, _now, 10);
+}
+
+void runTo(TimerWheel &wheel, unsigned long now) {
+  _now = now;
+  wheel.run(now);
+}
+} // namespace
+
+void setUp() {
+  _fired_a = 0;
+  _fired_b = 0;
+  _now = 0;
+}
+
+void tearDown() {}
+
+void testCascade() {
+  TimerWheel wheel;
+  Timer timer(fireA);
+  wheel.start(timer, 0, 300);
+  unsigned long deadline;
+  TEST_ASSERT_TRUE(wheel.nextDeadline(deadline));
+  TEST_ASSERT_EQUAL_UINT32(256, deadline);
+  runTo(wheel, 256);
+  TEST_ASSERT_EQUAL(0, _fired_a);
+  TEST_ASSERT_TRUE(wheel.nextDeadline(deadline));
+  TEST_ASSERT_EQUAL_UINT32(300, deadline);
+  runTo(wheel, 299);
+  TEST_ASSERT_EQUAL(0, _fired_a);
+  runTo(wheel, 300);
+  TEST_ASSERT_EQUAL(1, _fired_a);
+  TEST_ASSERT_FALSE(wheel.nextDeadline(deadline));
+}
+
+void testBeyondHorizon() {
+  TimerWheel wheel;
+  Timer timer(fireA);
+  wheel.start(timer, 0, 40000);
+  unsigned long deadline;
+  while (wheel.nextDeadline(deadline) && deadline < 40000) {
+    runTo(wheel, deadline);
+    TEST_ASSERT_EQUAL(0, _fired_a);
+  }
+  TEST_ASSERT_EQUAL_UINT32(40000, deadline);
+  runTo(wheel, deadline);
+  TEST_ASSERT_EQUAL(1, _fired_a);
+}
+
+void testStartFromCallbackWhileCatchingUp() {
+  TimerWheel wheel;
+  _wheel = &wheel;
+  Timer timer(startB);
+  wheel.start(timer, 0, 5);
+  // The wheel empties at tick 5 and the callback starts B due at 100, which
+  // the same run still has to reach.
+  runTo(wheel, 100);
+  TEST_ASSERT_EQUAL(1, _fired_a);
+  TEST_ASSERT_EQUAL(1, _fired_b);
+  TEST_ASSERT_FALSE(_b.running());
+}
+
+void testRearmFromCallback() {
+  TimerWheel wheel;
+  _wheel = &wheel;
+  _rearmed.callback = rearm;
+  wheel.start(_rearmed, 0, 10);
+  runTo(wheel, 9);
+  TEST_ASSERT_EQUAL(0, _fired_a);
+  runTo(wheel, 10);
+  TEST_ASSERT_EQUAL(1, _fired_a);
+  runTo(wheel, 19);
+  TEST_ASSERT_EQUAL(1, _fired_a);
+  runTo(wheel, 20);
+  TEST_ASSERT_EQUAL(2, _fired_a);
+  runTo(wheel, 30);
+  TEST_ASSERT_EQUAL(3, _fired_a);
+  TEST_ASSERT_FALSE(_rearmed.running());
+}
+
+void testPeriodic() {
+  TimerWheel wheel;
+  Timer timer(fireA);
+  wheel.start(timer, 0, 100, 100);
+  for (unsigned long now = 0; now <= 1000; now++)
+    runTo(wheel, now);
+  TEST_ASSERT_EQUAL(10, _fired_a);
+  wheel.stop(timer);
+  unsigned long deadline;
+  TEST_ASSERT_FALSE(wheel.nextDeadline(deadline));
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(testCascade);
+  RUN_TEST(testBeyondHorizon);
+  RUN_TEST(testStartFromCallbackWhileCatchingUp);
+  RUN_TEST(testRearmFromCallback);
+  RUN_TEST(testPeriodic);
+  return UNITY_END();
+}